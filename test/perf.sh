@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# perf.sh: performance regression test.  Run a fixed loopback workload
+# with scripts/fabtsweep and compare fabtget's mean throughput and CPU
+# seconds per GB with the baseline JSON file.  Fail if throughput falls,
+# or CPU cost rises, by more than the baseline's tolerance.  Exit 77
+# (skipped), without running the workload, if the baseline has no
+# measurements yet.
+#
+# With -u, measure and write the results to the baseline file instead.
+#
+
+set -e
+set -u
+
+prog=$(basename $0)
+update=no
+
+usage()
+{
+	echo "usage: ${prog} [-u] <fabtsweep> <baseline.json>" 1>&2
+	exit 1
+}
+
+# Print the value of key $1 in the flat JSON object in file $2.
+json_get()
+{
+	sed -n "s/^ *\"$1\": *\"\{0,1\}\([^\",]*\)\"\{0,1\},\{0,1\} *$/\1/p" $2
+}
+
+while getopts "u" opt; do
+	case $opt in
+	u)
+		update=yes
+		;;
+	*)
+		usage
+		;;
+	esac
+done
+shift $(($OPTIND - 1))
+
+if [ $# -ne 2 ]; then
+	usage
+fi
+
+sweep=$1
+baseline=$2
+
+provider=$(json_get provider $baseline)
+sessions=$(json_get sessions $baseline)
+reps=$(json_get repetitions $baseline)
+mbps_base=$(json_get get_mbps $baseline)
+mbps_tol=$(json_get get_mbps_tolerance $baseline)
+cpu_base=$(json_get get_cpu_s_per_gb $baseline)
+cpu_tol=$(json_get get_cpu_s_per_gb_tolerance $baseline)
+
+# Without a baseline there is nothing to compare with, so skip the
+# sweep, too.
+if [ $update = no ] && \
+    { [ "$mbps_base" = null ] || [ "$cpu_base" = null ]; }; then
+	echo "${prog}: no baseline recorded in $baseline;" \
+	    "record one with \`make perf-baseline'" 1>&2
+	exit 77
+fi
+
+if [ ! -e fabtput ]; then
+	ln -s fabtget fabtput
+fi
+
+# Keep only the `default` row; fields 6 and 12 are the means of
+# get_mbps and get_cpu_s_per_gb.
+result=$(FI_PROVIDER=${FI_PROVIDER:-$provider} PATH=.:$PATH \
+    sh $sweep -r $reps -n $sessions | awk -F, 'NR == 2')
+ok=$(echo $result | cut -d, -f5)
+mbps=$(echo $result | cut -d, -f6)
+cpu=$(echo $result | cut -d, -f12)
+
+if [ "${ok:-0}" -ne $reps ] || [ -z "$mbps" ] || [ -z "$cpu" ]; then
+	echo "${prog}: only ${ok:-0} of $reps runs succeeded" 1>&2
+	exit 1
+fi
+
+echo "${prog}: provider $provider, $sessions sessions, $reps runs:" \
+    "$mbps MB/s, $cpu CPU s/GB"
+
+if [ $update = yes ]; then
+	cat > $baseline <<BASELINE_EOF
+{
+    "provider": "$provider",
+    "sessions": $sessions,
+    "repetitions": $reps,
+    "get_mbps": $mbps,
+    "get_mbps_tolerance": $mbps_tol,
+    "get_cpu_s_per_gb": $cpu,
+    "get_cpu_s_per_gb_tolerance": $cpu_tol
+}
+BASELINE_EOF
+	echo "${prog}: updated $baseline"
+	exit 0
+fi
+
+echo "${prog}: baseline $mbps_base MB/s, $cpu_base CPU s/GB"
+
+awk -v mbps=$mbps -v mbps_base=$mbps_base -v mbps_tol=$mbps_tol \
+    -v cpu=$cpu -v cpu_base=$cpu_base -v cpu_tol=$cpu_tol '
+BEGIN {
+	failed = 0
+	if (mbps < mbps_base * (1 - mbps_tol)) {
+		printf "throughput regressed: %.3f < %.3f MB/s\n", mbps,
+		    mbps_base * (1 - mbps_tol)
+		failed = 1
+	}
+	if (cpu > cpu_base * (1 + cpu_tol)) {
+		printf "CPU cost regressed: %.3f > %.3f CPU s/GB\n", cpu,
+		    cpu_base * (1 + cpu_tol)
+		failed = 1
+	}
+	exit failed
+}' 1>&2
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# tduration.sh: run fabtget and fabtput for a 1-second warm-up and a
+# 2-second measurement window (-D 1,2), and check that each prints a
+# `total` record for a window that moved bytes.
+#
+
+set -e
+set -u
+
+tmpdir=$(mktemp -d tduration.XXXXXX)
+trap 'rm -rf $tmpdir' EXIT
+
+ln -sf fabtget fabtput
+
+./fabtget -D 1,2 -i 1 -a $tmpdir/addr > $tmpdir/get.csv &
+pid=$!
+sleep 2
+
+if ! ./fabtput -D 1,2 -i 1 $(cat $tmpdir/addr) > $tmpdir/put.csv; then
+	kill $pid 2> /dev/null || true
+	wait $pid || true
+	exit 1
+fi
+
+wait $pid
+
+for which in get put; do
+	if ! awk -F, '$2 == "total" && $3 > 0 { found = 1 }
+	    END { exit !found }' $tmpdir/$which.csv; then
+		echo "fabt$which printed no total record" 1>&2
+		exit 1
+	fi
+done
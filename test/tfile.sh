@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# tfile.sh: move a file from fabtput to fabtget with -f and compare the
+# copy with the original.  Pass the fabtget options in $GET_FLAGS and
+# the fabtput options in $PUT_FLAGS.  Half of the file is random, and
+# half repeats a line, so that a compressor has work on both.
+#
+
+set -e
+set -u
+
+tmpdir=$(mktemp -d tfile.XXXXXX)
+trap 'rm -rf $tmpdir' EXIT
+
+ln -sf fabtget fabtput
+
+{
+	head -c 1500000 /dev/urandom
+	yes 'fabtsuite file round trip' | head -c 1500000
+} > $tmpdir/in
+
+./fabtget ${GET_FLAGS:-} -f $tmpdir/out -a $tmpdir/addr &
+pid=$!
+sleep 2
+
+if ! ./fabtput ${PUT_FLAGS:-} -f $tmpdir/in $(cat $tmpdir/addr); then
+	kill $pid 2> /dev/null || true
+	wait $pid || true
+	exit 1
+fi
+
+wait $pid
+cmp $tmpdir/in $tmpdir/out
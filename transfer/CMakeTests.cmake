@@ -4,6 +4,63 @@ add_test (
     COMMAND test.sh
 )
 
+# Move a file with -f and compare the copy.
+add_test (
+    NAME file-round-trip
+    COMMAND tfile.sh
+)
+
+# Compress the file on fabtput, decompress it on fabtget, and compare.
+add_test (
+    NAME compress-round-trip
+    COMMAND tfile.sh
+)
+set_tests_properties (compress-round-trip PROPERTIES
+    ENVIRONMENT "PUT_FLAGS=-F compress;GET_FLAGS=-F decompress"
+)
+
+# Move the file in page-multiple buffers, through O_DIRECT where the
+# file system allows it, with other queue depths.
+add_test (
+    NAME direct-round-trip
+    COMMAND tfile.sh
+)
+set_tests_properties (direct-round-trip PROPERTIES
+    ENVIRONMENT "PUT_FLAGS=-B 4096 -Q 8;GET_FLAGS=-B 65536 -Q 64"
+)
+
+# Run for a -D window and check for the total record.
+add_test (
+    NAME duration
+    COMMAND tduration.sh
+)
+
+# Guard local performance against a stored baseline.  Record the
+# baseline on the reference machine with `make perf-baseline`.  Until
+# the baseline has measurements, there is no gate to register; a new
+# baseline reconfigures the build, which registers it.
+set (PERF_SWEEP ${CMAKE_CURRENT_SOURCE_DIR}/../scripts/fabtsweep)
+set (PERF_BASELINE ${CMAKE_CURRENT_SOURCE_DIR}/../test/perf-baseline.json)
+set_property (DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS
+    ${PERF_BASELINE}
+)
+file (READ ${PERF_BASELINE} PERF_BASELINE_JSON)
+if (NOT PERF_BASELINE_JSON MATCHES "\"get_(mbps|cpu_s_per_gb)\": *null")
+add_test (
+    NAME performance
+    COMMAND perf.sh ${PERF_SWEEP} ${PERF_BASELINE}
+)
+set_tests_properties (performance PROPERTIES
+    SKIP_RETURN_CODE 77
+    RUN_SERIAL TRUE
+)
+endif ()
+add_custom_target (perf-baseline
+    COMMAND ./perf.sh -u ${PERF_SWEEP} ${PERF_BASELINE}
+    DEPENDS fabtget
+    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+)
+
 # Test Crusher.
 if (${SLURM})
 include(CMakeTests_s.cmake)
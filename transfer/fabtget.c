@@ -7,9 +7,13 @@
 
 #include <assert.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>    /* fcntl(2), open(2) */
 #include <inttypes.h> /* PRIu32 */
 #include <libgen.h>   /* basename(3) */
 #include <limits.h>   /* INT_MAX */
+#include <math.h>     /* cos(3), exp(3), log(3), sqrt(3) */
+#include <poll.h>     /* poll(2) */
 #include <sched.h>    /* CPU_SET(3) */
 #include <signal.h>
 #include <stdalign.h>
@@ -19,9 +23,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> /* strcmp(3), strdup(3) */
+#include <time.h>   /* clock_gettime(2) */
 #include <unistd.h> /* getopt(3), sysconf(3) */
 
 #include <sys/epoll.h>
+#include <sys/ioctl.h>   /* ioctl(2) */
+#include <sys/mman.h>    /* mmap(2) */
+#include <sys/stat.h>    /* fstat(2) */
+#include <sys/syscall.h> /* SYS_perf_event_open, SYS_io_uring_setup */
+#include <sys/uio.h>     /* readv(2), writev(2) */
+
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h> /* __rdtsc() */
+#endif
 
 #include <rdma/fabric.h>
 #include <rdma/fi_cm.h> /* fi_listen, fi_getname */
@@ -30,6 +47,7 @@
 #include <rdma/fi_rma.h>    /* struct fi_msg_rma */
 #include <rdma/fi_tagged.h> /* struct fi_msg_tagged */
 
+#include "fabtstats.h"
 #include "hlog.h"
 
 #define arraycount(a) (sizeof(a) / sizeof(a[0]))
@@ -48,7 +66,8 @@ typedef struct {
 typedef struct initial_msg {
     nonce_t nonce;
     uint32_t nsources;
-    uint32_t id;
+    uint32_t id;    // the transmitter's session index, 0 to `nsources` - 1
+    uint32_t timed; // 1 if the transmitter runs for a duration (-D)
     uint32_t addrlen;
     char addr[512];
 } initial_msg_t;
@@ -58,9 +77,13 @@ typedef struct ack_msg {
     char addr[512];
 } ack_msg_t;
 
+/* Control messages carry sequence numbers, so that a receiver may
+ * process them as they arrive, yet restore their order where the
+ * protocol needs it.
+ */
 typedef struct vector_msg {
     uint32_t niovs;
-    uint32_t pad;
+    uint32_t seq;
     struct {
         uint64_t addr, len, key;
     } iov[12];
@@ -69,6 +92,8 @@ typedef struct vector_msg {
 typedef struct progress_msg {
     uint64_t nfilled;
     uint64_t nleftover;
+    uint32_t seq;
+    uint32_t pad;
 } progress_msg_t;
 
 /* Communication buffers */
@@ -93,12 +118,14 @@ typedef struct {
     uint32_t place : 2;
     uint32_t nchildren : 8;
     uint32_t cancelled : 1;
-    uint32_t unused : 16;
+    uint32_t signaled : 1; // an RDMA write that requests a completion
+    uint32_t unused : 15;
 } xfer_context_t;
 
 typedef struct completion {
     uint64_t flags;
     size_t len;
+    void *buf; // with -M, where a multi-receive buffer holds the message
     xfer_context_t *xfc;
 } completion_t;
 
@@ -111,6 +138,7 @@ typedef struct bufhdr {
     void *desc;
     uint64_t tag;
     struct fid_ep *ep;
+    void *base; // start of the allocation, for buf_free
     max_align_t pad;
 } bufhdr_t;
 
@@ -166,6 +194,9 @@ typedef struct terminal terminal_t;
 struct terminal {
     /* trade(t, ready, completed) */
     loop_control_t (*trade)(terminal_t *, fifo_t *, fifo_t *);
+    /* optional; wait out I/O, release; false if the I/O failed */
+    bool (*shutdown)(terminal_t *);
+    size_t nheld; // buffers the terminal holds apart from its FIFOs
 };
 
 typedef struct {
@@ -180,8 +211,140 @@ typedef struct {
     size_t idx;
     size_t txbuflen;
     size_t entirelen;
+    uint64_t rng; // state of the buffer-size generator (-d)
 } source_t;
 
+/* How the source chooses the number of bytes to put in each buffer. */
+typedef enum {
+    sd_buffer = 0, // fill each buffer
+    sd_fixed,      // always `a` bytes
+    sd_uniform,    // `a` through `b` bytes, uniformly
+    sd_bimodal,    // `a` bytes with probability `p`, otherwise `b` bytes
+    sd_lognormal,  // lognormal with median `a` and shape `sigma`
+    sd_hist        // replay the frequencies in `bin`
+} size_dist_t;
+
+typedef struct {
+    size_t size;
+    uint64_t cum; // occurrences of this size and all earlier ones
+} size_bin_t;
+
+/* An io_uring(7) instance that a file terminal submits its reads or
+ * writes to.  The kernel shares the rings with us through mmap(2).
+ */
+typedef struct {
+    int fd;             // returned by io_uring_setup(2)
+    unsigned depth;     // submission queue entries
+    unsigned nqueued;   // entries queued but not yet submitted
+    unsigned ninflight; // entries queued or submitted, but not reaped
+    struct {
+        void *ring;
+        size_t ringlen;
+        unsigned *head, *tail, *mask, *array;
+        struct io_uring_sqe *sqes;
+        size_t sqeslen;
+    } sq;
+    struct {
+        void *ring;
+        size_t ringlen;
+        unsigned *head, *tail, *mask;
+        struct io_uring_cqe *cqes;
+    } cq;
+} uring_t;
+
+/* A file terminal registers at most this many buffers with its ring,
+ * twice the number that a session keeps in circulation.
+ */
+#define FILE_FIXED_MAX 128
+
+/* A terminal that reads the payload from a file (fabtput) or writes it
+ * to a file (fabtget) instead of generating or verifying it (-f).
+ */
+typedef struct {
+    terminal_t terminal;
+    uring_t ring;
+    int fd;
+    uint64_t offset;   // file offset of the next read or write
+    size_t nsubmitted; // items, from the head of `ready`, with I/O issued
+    bool eof;          // a read came up short: issue no more reads
+    bool direct;       // `fd` is open with O_DIRECT
+    /* With page-aligned buffers, the payloads that the terminal has
+     * seen.  The first `nregistered` are registered with `ring`, so
+     * that the kernel pins and maps them once instead of on every read
+     * or write.
+     */
+    struct {
+        struct iovec iov[FILE_FIXED_MAX];
+        size_t n;
+        size_t nregistered;
+        bool enabled; // false if the buffers are unaligned or pinning failed
+    } fixed;
+} file_terminal_t;
+
+/* A terminal that reads the payload from standard input (fabtput) or
+ * writes it to standard output (fabtget) (-f -).
+ */
+typedef struct {
+    terminal_t terminal;
+    int fd;
+    int flags;  // file status flags of `fd` before the sink set O_NONBLOCK
+    bool pipe;  // `fd` is a pipe: read it with vmsplice(2)
+    size_t ofs; // bytes of the head buffer already written
+} stream_terminal_t;
+
+#define FILTERS_MAX 8
+
+/* A terminal that passes each buffer from `ready` to `completed`,
+ * calling `apply` on it along the way (-F).  Most filters keep the
+ * length of each buffer.  The compressor on fabtput and the
+ * decompressor on fabtget change the length of the stream instead, so
+ * they pack their output into buffers of their own choosing.
+ */
+typedef struct filter filter_t;
+
+struct filter {
+    terminal_t terminal;
+    const char *name;
+    void (*apply)(filter_t *, bufhdr_t *);
+    uint32_t adler[2];   // running Adler-32 sums (adler32)
+    uint64_t nbytes;     // payload bytes that passed through
+    uint64_t nbufs;      // buffers that passed through
+    uint64_t nbytes_out; // payload bytes passed on (compress, decompress)
+    uint64_t ticks;      // stage clock ticks spent in `apply`
+    /* The compressor's frames, or the decompressor's decoded bytes,
+     * wait in `staged` until there is a buffer to carry them.  When
+     * they outgrow the input buffers, the filter takes empty buffers
+     * from `spares`: the source's supply on fabtput, the sink's returns
+     * on fabtget.  The decompressor keeps the start of a frame that is
+     * split across buffers in `in` until the rest arrives.
+     */
+    struct {
+        uint8_t *staged; // frames or decoded bytes not yet in a buffer
+        size_t len;      // bytes staged
+        size_t size;     // bytes allocated for `staged`
+        uint8_t *in;     // frame bytes not yet decoded
+        size_t inlen;    // bytes in `in`
+        size_t insize;   // bytes allocated for `in`
+        size_t bufsize;  // the largest buffer seen
+        uint32_t *table; // LZ77 hash table
+        fifo_t *spares;
+        bool bad; // a frame did not decode
+    } lz;
+};
+
+/* A terminal that runs a session's source or sink and its filters in
+ * turn, with a FIFO between each stage and the next.  On fabtput the
+ * source comes first; on fabtget the sink comes last.
+ */
+typedef struct {
+    terminal_t terminal;
+    terminal_t *stage[FILTERS_MAX + 1];
+    fifo_t *between[FILTERS_MAX];
+    filter_t filter[FILTERS_MAX];
+    size_t nstages;
+    bool sink; // the chain ends at a sink (fabtget)
+} chain_t;
+
 typedef struct seqsource {
     uint64_t next_key;
 } seqsource_t;
@@ -203,12 +366,45 @@ typedef struct {
     bool local, remote;
 } eof_state_t;
 
+/* Counters that a connection publishes for the monitor thread and for
+ * external monitors.  Only the worker servicing the connection writes
+ * them, and readers use relaxed loads, so neither side takes a lock.
+ */
+typedef fabtstats_session_t cxn_stats_t;
+
+/* Stages of a session-loop pass that -t times separately. */
+typedef enum {
+    sg_trade = 0,         // terminal trade
+    sg_cq,                // CQ processing
+    sg_vecbuf_unload,     // xmtr_vecbuf_unload
+    sg_targets_write,     // xmtr_targets_write
+    sg_progress_update,   // xmtr_progress_update
+    sg_vector_update,     // rcvr_vector_update
+    sg_txctl_transmit,    // txctl_transmit
+    sg_targets_read,      // rcvr_targets_read
+    sg_nstages
+} stage_t;
+
+/* Accumulated clock ticks and calls for each stage. */
+typedef struct {
+    uint64_t ticks[sg_nstages];
+    uint64_t ncalls[sg_nstages];
+} stage_times_t;
+
+/* A sample of the cumulative `cxn_stats_t` counters. */
+typedef struct {
+    uint64_t nbytes;
+    uint64_t nwrites;
+    uint64_t nctlmsgs;
+} cxn_counts_t;
+
 struct cxn {
     uint32_t magic;
     loop_control_t (*loop)(worker_t *, session_t *);
     void (*shutdown)(cxn_t *);
     void (*cancel)(cxn_t *);
     bool (*cancellation_complete)(cxn_t *);
+    void (*dump)(cxn_t *); // log the connection state for diagnosis
     struct fid_ep *ep;
     fi_addr_t peer_addr;
     struct fid_cq *cq;
@@ -217,7 +413,7 @@ struct cxn {
                      * ready
                      */
     struct fid_av *av;
-    session_t *parent; // pointer to the connection's current session_t
+    session_t *parent; // pointer to the connection's session_t slot
     bool sent_first;   /* receiving: set to `true` once this receiver sends an
                         * acknowledgement for the transmitter's original
                         * message
@@ -236,6 +432,34 @@ struct cxn {
      */
     eof_state_t eof;
     seqsource_t keys;
+    cxn_stats_t *stats; // in the stats segment (-m) or `stats_private`
+    cxn_stats_t stats_private;
+    uint64_t ncompletions; // completions read from `cq`
+    stage_times_t stages;  // with -t, time spent in each loop stage
+    volatile atomic_bool stalled; /* the monitor sets this to ask the worker
+                                   * to report on the connection; the
+                                   * worker clears it
+                                   */
+    struct {
+        uint64_t nbytes;   // `stats->nbytes` at the last sample
+        uint64_t moved_at; // CLOCK_MONOTONIC ns when `nbytes` changed
+        bool reported;     // already flagged since `moved_at`
+    } watchdog;            // private to the monitor thread
+    struct {
+        cxn_counts_t counts; // counters at the last throughput report
+        bool closed;         // closed at the last throughput report
+        cxn_counts_t window[2]; // counters when the -D window opened, closed
+    } report;                   // private to the monitor thread
+    /* With -q, the worker runs a deficit round-robin over its ready
+     * sessions: on each pass, a session may issue `deficit` more RDMA
+     * writes (transmitter) or vector messages (receiver).  A session
+     * that still has work at the end of a pass carries what it did not
+     * spend, up to `weight`, into the next.
+     */
+    struct {
+        unsigned weight;  // operations added to `deficit` per pass
+        unsigned deficit; // operations left in this pass
+    } drr;
 };
 
 typedef struct {
@@ -243,6 +467,13 @@ typedef struct {
     fifo_t *rcvd;   // buffers holding received vector messages
     seqsource_t tags;
     uint64_t ignore;
+    xfc_type_t type; // type of the messages received
+    size_t msglen;   // length of the longest message
+    /* With -M, `posted` holds multi-receive buffers.  Each message
+     * is copied out of them to a buffer from `pool`, or to a new buffer
+     * if `pool` is empty.
+     */
+    buflist_t *pool;
 } rxctl_t;
 
 typedef struct {
@@ -251,8 +482,11 @@ typedef struct {
     buflist_t *pool; // unused buffers
     seqsource_t tags;
     uint64_t ignore;
+    uint64_t flags; // additional flags for each transmission
+    uint32_t nextseq; // sequence number of the next message
     unsigned rotate_ready_countdown; // counts down to 0, then resets
                                      // to rotate_ready_interval
+    bool more_pending; // the last post carried FI_MORE
 } txctl_t;
 
 typedef struct {
@@ -278,6 +512,14 @@ typedef struct {
     } initial;
     txctl_t vec;
     rxctl_t progress;
+    /* Progress messages add up in any order, but the remote EOF takes
+     * effect only after every progress message before it.
+     */
+    struct {
+        uint32_t nprocessed; // progress messages processed
+        uint32_t eofseq;     // sequence number of the remote EOF
+        bool eof;            // received the remote EOF
+    } progseq;
     unsigned split_vector_countdown; // counts down to 0, then resets
                                      // to split_vector_interval
 } rcvr_t;
@@ -321,6 +563,30 @@ typedef struct {
                     */
     unsigned split_progress_countdown; // counts down to 0, then resets
                                        // to split_progress_interval
+    struct {
+        size_t nunsignaled; // unsignaled writes since the last signaled one
+        size_t noutstanding; // signaled writes not completed yet
+    } signal;
+    /* Scoreboard of `wrposted`, indexed by `fifo_alt_index`.  A buffer
+     * returns to the terminal as soon as its own write completes, but
+     * its bytes count toward progress only when every write before it
+     * has completed, too.
+     */
+    struct {
+        uint64_t done;     // bit i: the write of entry i completed
+        uint64_t released; /* bit i: entry i went back to the terminal
+                            * or the fragment pool; its pointer is stale
+                            */
+        size_t nbytes[64]; // bytes that entry i adds to the progress
+    } wrsb;
+    /* Vector messages that arrived ahead of their turn wait here,
+     * indexed by sequence number, until `vec.rcvd` can take them in
+     * order.
+     */
+    struct {
+        uint32_t next;       // sequence number of the next vector
+        bufhdr_t *early[64]; // vectors received ahead of `next`
+    } vecseq;
 } xmtr_t;
 
 /* On each loop, a worker checks its poll set for any completions.
@@ -339,12 +605,31 @@ typedef struct {
     uint32_t ctxs_serviced_since_mark;
     int max_loop_contexts;
     int min_loop_contexts;
+    /* With -W, the fraction of wall-clock time that the worker spent
+     * servicing ready sessions, in the same fixed point as `average`,
+     * and averaged with the previous figure every `utilization_period`
+     * nanoseconds.  Time asleep in epoll_pwait(2) under -w, and time
+     * polling with no session ready, count as idle.  The pool
+     * controller reads it.
+     */
+    volatile atomic_uint_fast16_t utilization;
+    uint64_t mark_wall_ns; // CLOCK_MONOTONIC at the last utilization mark
+    uint64_t mark_cpu_ns;  // CLOCK_THREAD_CPUTIME_ID at the same mark
+    /* Stage-clock ticks spent servicing sessions since the last
+     * utilization mark.
+     */
+    uint64_t busy_ticks;
+    bool marked; // a utilization mark happened since the last consolidation
 } load_t;
 
 #define WORKER_SESSIONS_MAX 8
 #define WORKERS_MAX         128
 #define SESSIONS_MAX        (WORKER_SESSIONS_MAX * WORKERS_MAX)
 
+#if WORKERS_MAX > FABTSTATS_WORKERS_MAX
+#error "the stats segment has too few worker slots"
+#endif
+
 struct session {
     terminal_t *terminal;
     cxn_t *cxn;
@@ -353,34 +638,40 @@ struct session {
     bool waitable;
 };
 
-typedef struct worker_stats worker_stats_t;
+typedef fabtstats_worker_t worker_stats_t;
 
-struct worker_stats {
-    struct {
-        uint64_t waitable;
-        uint64_t total;
-    } epoll_loops;
-    struct {
-        uint64_t no_io_ready;
-        uint64_t no_session_ready;
-        uint64_t total;
-    } half_loops;
-};
+#define PERF_EVENTS_MAX 4
 
 struct worker {
     pthread_t thd;
     sigset_t epoll_sigset;
     load_t load;
     terminal_t *term[WORKER_SESSIONS_MAX];
-    session_t session[WORKER_SESSIONS_MAX];
+    session_t session[WORKER_SESSIONS_MAX]; // only the worker touches these
     volatile _Atomic size_t nsessions[2]; // number of sessions in each half
                                           // of session[]
-    struct fid_poll *pollset[2];
-    pthread_mutex_t mtx[2]; /* mtx[0] protects pollset[0] and the first half
-                             * of session[]; mtx[1], pollset[1] and the second
-                             * half
-                             */
-    pthread_cond_t sleep;   /* Used in conjunction with workers_mtx. */
+    /* Other threads hand sessions to the worker through `inbox`, a ring
+     * that the worker drains at the top of each loop.  A thread claims
+     * room for a session by increasing `nassigned`, which counts the
+     * sessions in the inbox and in session[], so the inbox never holds
+     * more entries than session[] has free slots.
+     */
+    struct {
+        session_t session[WORKER_SESSIONS_MAX];
+        volatile atomic_bool full[WORKER_SESSIONS_MAX];
+        volatile _Atomic size_t tail; // next entry that a thread fills
+        size_t head;                  // next entry that the worker drains
+    } inbox;
+    volatile _Atomic size_t nassigned;
+    /* Sessions stay in their session[] slots for life.  In each half,
+     * bit i stands for slot i of the half.
+     */
+    struct {
+        unsigned occupied; // the slot holds a session
+        unsigned pending;  // the session is ready even without I/O
+    } slots[2];
+    struct fid_poll *pollset[2]; // CQs of each half of session[]
+    pthread_cond_t sleep;        /* Used in conjunction with workers_mtx. */
     volatile atomic_bool shutting_down;
     volatile atomic_bool canceled;
     bool failed;
@@ -390,13 +681,31 @@ struct worker {
         buflist_t *rx;
     } paybufs; /* Reservoirs for free payload buffers. */
     seqsource_t keys;
-    worker_stats_t stats;
+    worker_stats_t *stats; // in the stats segment (-m) or `stats_private`
+    worker_stats_t stats_private;
+    struct {
+        uint64_t nbytes;       // payload bytes moved by finished sessions
+        uint64_t ncompletions; // completions read by finished sessions
+        stage_times_t stages;  // stage times of finished sessions
+    } totals;
+    struct {
+        int fd[PERF_EVENTS_MAX]; // perf_event_open(2) descriptors, or -1
+        uint64_t count[PERF_EVENTS_MAX];
+    } perf; // hardware counters for this thread (-e)
+    struct {
+        uint64_t wall_ns;          // CLOCK_MONOTONIC time the thread ran
+        uint64_t cpu_ns;           // CLOCK_THREAD_CPUTIME_ID time it used
+        uint64_t nidle_half_loops; // half loops with no I/O or session ready
+    } cpu;
     int epoll_fd; /* returned by epoll_create(2) */
 };
 
 typedef struct {
     struct fi_context ctx; // this has to be the first member
     sink_t sink;
+    file_terminal_t file;     // replaces `sink` with -f <path>
+    stream_terminal_t stream; // replaces `sink` with -f -
+    chain_t chain;            // puts filters in front of the sink (-F)
     rcvr_t rcvr;
     session_t sess;
 } get_session_t;
@@ -410,6 +719,9 @@ typedef struct {
 
 typedef struct {
     source_t source;
+    file_terminal_t file;     // replaces `source` with -f <path>
+    stream_terminal_t stream; // replaces `source` with -f -
+    chain_t chain;            // puts filters after the source (-F)
     xmtr_t xmtr;
     session_t sess;
 } put_session_t;
@@ -435,6 +747,21 @@ typedef struct {
     bool expect_cancellation;
     bool reregister;
     bool waitfd;
+    bool batch;      // set FI_MORE on all but the last post of a batch
+    bool multi_recv; // receive control messages with FI_MULTI_RECV
+    size_t signal_interval; // request a completion on every nth RDMA write
+    struct {
+        unsigned w[16]; // operations per pass of session i is w[i % n]
+        size_t n;       // number of weights, or 0 to schedule unweighted
+    } weights;
+    bool run_to_completion; // service sessions on the main thread (-R)
+    struct {
+        bool adaptive; // size the worker pool by utilization (-W)
+        size_t min;    // spread sessions over at least this many workers
+        size_t max;    // never start more than this many workers
+    } pool;
+    bool transmit_complete; // RDMA-write with FI_TRANSMIT_COMPLETE
+    bool progress_fence;    // fence progress messages behind RDMA writes
     bool mr_endpoint;
     size_t local_sessions;
     size_t total_sessions;
@@ -443,6 +770,54 @@ typedef struct {
     struct {
         unsigned first, last;
     } processors;
+    struct {
+        uint64_t interval; /* nanoseconds a session may go without moving
+                            * bytes before the watchdog reports it, or 0
+                            * to disable the watchdog
+                            */
+        bool cancel;       // cancel the sessions that the watchdog reports
+    } stall;
+    struct {
+        uint64_t interval; /* nanoseconds between throughput reports, or 0
+                            * to disable them
+                            */
+        bool json;         // report JSON lines instead of CSV
+    } report;
+    bool perf;              // count hardware events in each worker thread
+    bool stages;            // time each stage of the session loop
+    bool cpu_report;        // report the CPU cost of the transfer
+    const char *stats_path; // export live statistics to this file, or NULL
+    const char *file_path;  // read or write the payload here (-f), or NULL
+    int stream_fd;          // payload input or output with `-f -`
+    /* With -f, each file terminal keeps at most this many reads or
+     * writes in flight (-Q).  The default is half of a session FIFO, so
+     * that the connection has buffers to work with while the storage
+     * has the rest.  A deeper queue keeps the storage busier, a
+     * shallower one leaves the connection more buffers.
+     */
+    unsigned file_depth;
+    size_t bufsize;   // bytes in each payload buffer (-B), or 0 to vary
+    size_t page_size; // bytes in a page of memory
+    struct {
+        size_t kind[FILTERS_MAX]; // indices into `filter_kinds`
+        size_t n;                 // number of filters, or 0 for none
+    } filters;
+    struct {
+        size_dist_t dist;
+        size_t a, b;
+        double p, sigma;
+        size_t max;      // largest size drawn; 0 with `sd_buffer`
+        size_bin_t *bin; // histogram bins in increasing order of size
+        size_t nbins;
+        uint64_t seed;
+    } sizes; // sizes of the source's buffers (-d)
+    struct {
+        uint64_t warmup; // nanoseconds to run before measuring
+        uint64_t length; /* nanoseconds to measure, or 0 to move a
+                          * fixed number of bytes instead
+                          */
+        atomic_bool over; // the window closed: sources end their streams
+    } duration;           // time-bounded run (-D)
     volatile bool cancelled;
     pthread_t cancel_thd;
     pthread_t main_thd;
@@ -452,6 +827,11 @@ typedef struct {
 } state_t;
 
 HLOG_OUTLET_MEDIUM_DEFN(err, all, 0, HLOG_OUTLET_S_ON);
+HLOG_OUTLET_MEDIUM_DEFN(stall, all, 0, HLOG_OUTLET_S_ON);
+HLOG_OUTLET_MEDIUM_DEFN(perf, all, 0, HLOG_OUTLET_S_ON);
+HLOG_OUTLET_MEDIUM_DEFN(stages, all, 0, HLOG_OUTLET_S_ON);
+HLOG_OUTLET_MEDIUM_DEFN(cpu, all, 0, HLOG_OUTLET_S_ON);
+HLOG_OUTLET_MEDIUM_DEFN(filter, all, 0, HLOG_OUTLET_S_ON);
 HLOG_OUTLET_SHORT_DEFN(average, all);
 HLOG_OUTLET_SHORT_DEFN(close, all);
 HLOG_OUTLET_SHORT_DEFN(signal, all);
@@ -479,11 +859,39 @@ HLOG_OUTLET_SHORT_DEFN(session, all);
 HLOG_OUTLET_SHORT_DEFN(ooo, all);
 HLOG_OUTLET_SHORT_DEFN(addr, all);
 HLOG_OUTLET_SHORT_DEFN(poll, all);
+HLOG_OUTLET_SHORT_DEFN(pool, all);
+HLOG_OUTLET_SHORT_DEFN(window, all);
 HLOG_OUTLET_SHORT_DEFN(leak, all);
 
 static const unsigned split_progress_interval = 2047;
 static const unsigned split_vector_interval = 15;
 static const unsigned rotate_ready_interval = 3;
+/* With -M, each control channel keeps this many multi-receive buffers
+ * posted, each with room for this many of its longest message.
+ */
+static const size_t multi_recv_nbufs = 2;
+static const size_t multi_recv_nmsgs = 64;
+/* With -W, start another worker rather than add a session to a worker
+ * whose utilization is at least `pool_grow_utilization`, and let the
+ * last running worker hand off its sessions and park when its
+ * utilization falls below `pool_shrink_utilization`.  Both are
+ * fractions with 8 bits right of the decimal point, as in `load_t`.
+ * The gap between them keeps the pool from flapping.
+ */
+static const uint_fast16_t pool_grow_utilization = 192;
+static const uint_fast16_t pool_shrink_utilization = 64;
+/* With -W, a worker measures its utilization over periods of this many
+ * nanoseconds of wall-clock time.
+ */
+static const uint64_t utilization_period = 100 * 1000 * 1000;
+/* A payload buffer never holds more than this many bytes: -B sets no
+ * larger buffers, and with -d the source draws no larger sizes.
+ */
+static const size_t source_size_max = 65536;
+/* With `-f -`, move the bytes for at most this many buffers with each
+ * system call.
+ */
+#define STREAM_IOVS_MAX 64
 
 static state_t global_state = {.domain = NULL,
                                .fabric = NULL,
@@ -491,6 +899,11 @@ static state_t global_state = {.domain = NULL,
                                .personality = NULL,
                                .local_sessions = 1,
                                .total_sessions = 1,
+                               .signal_interval = 1,
+                               .file_depth = 32,
+                               .pool = {.adaptive = false,
+                                        .min = 0,
+                                        .max = WORKERS_MAX},
                                .processors = {.first = 0, .last = INT_MAX},
                                .cancelled = 0,
                                .peer_addr = NULL};
@@ -503,6 +916,36 @@ static pthread_cond_t nworkers_cond = PTHREAD_COND_INITIALIZER;
 
 static bool workers_assignment_suspended = false;
 
+/* The monitor thread periodically samples the counters of every
+ * connection in `cxn[0 .. ncxns - 1]`.  Only the main thread registers
+ * connections, publishing each by a release-store to `ncxns`.
+ */
+static struct {
+    pthread_t thd;
+    pthread_mutex_t mtx;
+    pthread_cond_t wakeup; // uses CLOCK_MONOTONIC
+    bool running;
+    bool stopping;         // protected by `mtx`
+    uint64_t period;       // nanoseconds between samples
+    uint64_t epoch;        // CLOCK_MONOTONIC ns when `cxn[0]` registered
+    _Atomic uint64_t first_byte; // CLOCK_MONOTONIC ns when any connection
+                                 // first moved a byte, or 0
+    struct {
+        uint64_t last;     // time of the previous throughput report
+        uint64_t due;      // time of the next throughput report
+        bool started;      // `last` and `due` are set, header printed
+    } report;
+    struct {
+        uint64_t begin;    // time the -D measurement window opened, or 0
+        uint64_t end;      // time it closed, or 0
+    } window;
+    cxn_t *cxn[SESSIONS_MAX];
+    volatile _Atomic size_t ncxns;
+} monitor = {.mtx = PTHREAD_MUTEX_INITIALIZER, .running = false};
+
+/* Live statistics exported for external monitors, or NULL. */
+static fabtstats_segment_t *stats_segment = NULL;
+
 static struct {
     int signum;
     struct sigaction saved_action;
@@ -511,6 +954,33 @@ static struct {
                {.signum = SIGQUIT},
                {.signum = SIGTERM}};
 
+/* Hardware events that each worker counts with -e. */
+static const struct {
+    uint64_t config;
+    const char *name;
+} perf_events[PERF_EVENTS_MAX] = {
+    {.config = PERF_COUNT_HW_CPU_CYCLES, .name = "cycles"},
+    {.config = PERF_COUNT_HW_INSTRUCTIONS, .name = "instructions"},
+    {.config = PERF_COUNT_HW_CACHE_MISSES, .name = "LLC misses"},
+    {.config = PERF_COUNT_HW_BRANCH_MISSES, .name = "branch misses"}};
+
+static const char *const stage_names[sg_nstages] = {
+    [sg_trade] = "trade",
+    [sg_cq] = "cq process",
+    [sg_vecbuf_unload] = "vecbuf unload",
+    [sg_targets_write] = "targets write",
+    [sg_progress_update] = "progress update",
+    [sg_vector_update] = "vector update",
+    [sg_txctl_transmit] = "txctl transmit",
+    [sg_targets_read] = "targets read"};
+
+/* Stage clock ticks and CLOCK_MONOTONIC nanoseconds when the program
+ * started, for converting ticks to nanoseconds.
+ */
+static struct {
+    uint64_t ticks, ns;
+} stage_epoch;
+
 static struct sigaction saved_wakeup1_action;
 static struct sigaction saved_wakeup2_action;
 
@@ -602,6 +1072,7 @@ completion_flags_to_string(const uint64_t flags, char *const buf,
 static const uint64_t desired_rx_flags = FI_RECV | FI_MSG;
 static const uint64_t desired_tagged_rx_flags = FI_RECV | FI_TAGGED;
 static const uint64_t desired_tagged_tx_flags = FI_SEND | FI_TAGGED;
+static const uint64_t desired_tx_flags = FI_SEND | FI_MSG;
 
 static uint64_t _Atomic next_key_pool = 512;
 
@@ -667,6 +1138,142 @@ size_is_power_of_2(size_t size)
     return ((size - 1) & size) == 0;
 }
 
+static uint64_t
+clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    if (clock_gettime(clk, &ts) == -1)
+        err(EXIT_FAILURE, "%s: clock_gettime", __func__);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/* Add `n` to a counter that only the calling thread writes.  Other
+ * threads may read the counter at any time.  A relaxed load and store
+ * suffice for that, and they avoid the cost of an atomic
+ * read-modify-write on the hot path.
+ */
+static inline void
+counter_add(volatile _Atomic uint64_t *ctr, uint64_t n)
+{
+    atomic_store_explicit(
+        ctr, atomic_load_explicit(ctr, memory_order_relaxed) + n,
+        memory_order_relaxed);
+}
+
+/* Count `n` more payload bytes moved by connection `c`.  Record when
+ * the first byte of the run moved, to anchor the measurements there
+ * rather than at connection setup.
+ */
+static inline void
+cxn_bytes_add(cxn_t *c, uint64_t n)
+{
+    uint64_t unset = 0;
+
+    if (n != 0 &&
+        atomic_load_explicit(&monitor.first_byte, memory_order_relaxed) == 0) {
+        (void) atomic_compare_exchange_strong_explicit(
+            &monitor.first_byte, &unset, clock_ns(CLOCK_MONOTONIC),
+            memory_order_relaxed, memory_order_relaxed);
+    }
+    counter_add(&c->stats->nbytes, n);
+}
+
+/* The clock for stage timing: the timestamp counter where there is a
+ * cheap one, CLOCK_MONOTONIC nanoseconds elsewhere.
+ */
+static inline uint64_t
+stage_clock(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return clock_ns(CLOCK_MONOTONIC);
+#endif
+}
+
+/* Return the time that a stage begins, or 0 if stages are not timed. */
+static inline uint64_t
+stage_begin(void)
+{
+    return global_state.stages ? stage_clock() : 0;
+}
+
+/* Charge the time since `begin` to stage `sg` of `c`.  Return the time
+ * that the next stage begins.
+ */
+static inline uint64_t
+stage_end(cxn_t *c, stage_t sg, uint64_t begin)
+{
+    uint64_t now;
+
+    if (!global_state.stages)
+        return 0;
+
+    now = stage_clock();
+    c->stages.ticks[sg] += now - begin;
+    c->stages.ncalls[sg]++;
+    return now;
+}
+
+static void
+stage_times_add(stage_times_t *sum, const stage_times_t *t)
+{
+    size_t i;
+
+    for (i = 0; i < sg_nstages; i++) {
+        sum->ticks[i] += t->ticks[i];
+        sum->ncalls[i] += t->ncalls[i];
+    }
+}
+
+/* Return the nanoseconds in a stage clock tick. */
+static double
+stage_ns_per_tick(void)
+{
+    const uint64_t ticks = stage_clock() - stage_epoch.ticks,
+                   ns = clock_ns(CLOCK_MONOTONIC) - stage_epoch.ns;
+
+    return (ticks == 0) ? 1. : (double) ns / (double) ticks;
+}
+
+/* Log a table of the time that `who` spent in each stage.  A NULL `who`
+ * labels an aggregate by `what` alone.
+ */
+static void
+stage_times_log(const char *what, const void *who, const stage_times_t *t)
+{
+    const double ns_per_tick = stage_ns_per_tick();
+    char label[64];
+    uint64_t total = 0;
+    size_t i;
+
+    if (who == NULL)
+        (void) snprintf(label, sizeof(label), "%s", what);
+    else
+        (void) snprintf(label, sizeof(label), "%s %p", what, who);
+
+    for (i = 0; i < sg_nstages; i++)
+        total += t->ticks[i];
+
+    hlog_fast(stages, "%s: %-16s %12s %12s %10s %6s", label, "stage", "calls",
+              "ms", "ns/call", "%");
+
+    for (i = 0; i < sg_nstages; i++) {
+        const double stage_ns = (double) t->ticks[i] * ns_per_tick;
+
+        if (t->ncalls[i] == 0)
+            continue;
+
+        hlog_fast(stages, "%s: %-16s %12" PRIu64 " %12.3f %10.1f %6.2f",
+                  label, stage_names[i], t->ncalls[i], stage_ns / 1e6,
+                  stage_ns / (double) t->ncalls[i],
+                  (total == 0) ? 0. : 100. * (double) t->ticks[i] /
+                                          (double) total);
+    }
+}
+
 static fifo_t *
 fifo_create(size_t size)
 {
@@ -748,6 +1355,29 @@ fifo_alt_get(fifo_t *f)
     return h;
 }
 
+/* Return the index into `f->hdr` of the item `i` places from the front
+ * of the FIFO.  Each index stays with its item until the item is
+ * removed.
+ */
+static inline size_t
+fifo_alt_index(const fifo_t *f, size_t i)
+{
+    return (f->removals + i) & (uint64_t) f->index_mask;
+}
+
+/* Return the item `i` places from the front of the FIFO without
+ * removing it, or NULL if the FIFO holds `i` or fewer items.  Does not
+ * respect the close position.
+ */
+static inline bufhdr_t *
+fifo_alt_peek_at(fifo_t *f, size_t i)
+{
+    if (f->insertions - f->removals <= i)
+        return NULL;
+
+    return f->hdr[fifo_alt_index(f, i)];
+}
+
 /* Return NULL if the FIFO is empty or if the FIFO has been read up to
  * the close position.  Otherwise, remove and return the next item on the
  * FIFO.
@@ -929,6 +1559,7 @@ buf_alloc(size_t paylen)
         return NULL;
 
     h->nallocated = paylen;
+    h->base = h;
 
     return h;
 }
@@ -936,13 +1567,44 @@ buf_alloc(size_t paylen)
 static void
 buf_free(bufhdr_t *h)
 {
-    free(h);
+    free(h->base);
+}
+
+/* Return true if every payload buffer is a whole number of pages (-B),
+ * so that each payload starts on a page boundary.
+ */
+static bool
+payload_page_aligned(void)
+{
+    return global_state.bufsize != 0 &&
+           global_state.bufsize % global_state.page_size == 0;
 }
 
+/* Allocate a buffer for `paylen` bytes of payload.  If `paylen` is a
+ * whole number of pages, start the payload on a page boundary, where
+ * O_DIRECT I/O can reach it, by putting the header at the end of a page
+ * of its own.
+ */
 static bytebuf_t *
 bytebuf_alloc(size_t paylen)
 {
-    return (bytebuf_t *) buf_alloc(paylen);
+    const size_t page = global_state.page_size;
+    const size_t hdrlen = offsetof(bytebuf_t, payload[0]);
+    bytebuf_t *b;
+    void *base;
+
+    if (paylen % page != 0 || hdrlen > page)
+        return (bytebuf_t *) buf_alloc(paylen);
+
+    if (posix_memalign(&base, page, page + paylen) != 0)
+        return NULL;
+
+    b = (bytebuf_t *) ((char *) base + page - hdrlen);
+    memset(b, 0, hdrlen + paylen);
+    b->hdr.nallocated = paylen;
+    b->hdr.base = base;
+
+    return b;
 }
 
 static fragment_t *
@@ -985,7 +1647,7 @@ vecbuf_alloc(void)
         return NULL;
 
     vb = (vecbuf_t *) h;
-    vb->msg.pad = 0;
+    vb->msg.seq = 0;
     h->xfc.type = xft_vector;
 
     return vb;
@@ -1055,7 +1717,7 @@ vecbuf_free(vecbuf_t *vb)
 static bool
 paybuflist_replenish(seqsource_t *keys, uint64_t access, buflist_t *bl)
 {
-    size_t i, paylen;
+    size_t i, paylen, size;
     int rc;
 
     if (bl->nfull >= bl->nallocated / 2)
@@ -1085,7 +1747,16 @@ paybuflist_replenish(seqsource_t *keys, uint64_t access, buflist_t *bl)
                 paylen = 23;
                 break;
         }
-        buf = bytebuf_alloc(paylen);
+        /* With -B, every buffer has the same size.  Otherwise, with
+         * -d, make room for the largest size that the source may draw.
+         */
+        if (global_state.bufsize != 0)
+            size = global_state.bufsize;
+        else if (global_state.sizes.max != 0)
+            size = global_state.sizes.max;
+        else
+            size = paylen;
+        buf = bytebuf_alloc(size);
         if (buf == NULL)
             err(EXIT_FAILURE, "%s.%d: malloc", __func__, __LINE__);
 
@@ -1095,7 +1766,7 @@ paybuflist_replenish(seqsource_t *keys, uint64_t access, buflist_t *bl)
             (rc = buf_mr_reg(global_state.domain, NULL, access,
                              seqsource_get(keys), &buf->hdr)) != 0) {
             warn_about_ofi_ret(rc, "buf_mr_reg");
-            free(buf);
+            buf_free(&buf->hdr);
             break;
         }
 
@@ -1265,113 +1936,282 @@ rxctl_ready(rxctl_t *ctl)
     return !fifo_full(ctl->posted);
 }
 
-static bufhdr_t *
-rxctl_complete(rxctl_t *rc, const completion_t *cmpl)
+/* Return true if batching is enabled and another receive will fit on
+ * `ctl` after the one that is about to be posted, so that the caller
+ * may set FI_MORE on it.
+ */
+static inline bool
+rxctl_more(rxctl_t *ctl)
 {
-    bufhdr_t *h, *head;
-
-    head = fifo_peek(rc->posted);
-
-    if (cmpl == NULL) {
-        goto out;
-    } else if (head == NULL) {
-        errx(EXIT_FAILURE, "%s: received a completion, but no Rx was posted",
-             __func__);
-    }
-
-    cmpl->xfc->owner = xfo_program;
-
-    if (cmpl->xfc->cancelled) {
-        ; /* do nothing; leave cancelled flag set, it's needed by
-           * higher-level processing---e.g., in xmtr_vector_rx_process
-           */
-    } else if ((cmpl->flags & desired_tagged_rx_flags) !=
-               desired_tagged_rx_flags) {
-        char difference[128];
-
-        errx(EXIT_FAILURE,
-             "%s: expected flags %" PRIu64
-             " differs from received flags %" PRIu64 " at %s",
-             __func__, desired_tagged_rx_flags,
-             cmpl->flags & desired_tagged_rx_flags,
-             completion_flags_to_string(
-                 desired_tagged_rx_flags ^
-                     (cmpl->flags & desired_tagged_rx_flags),
-                 difference, sizeof(difference)));
-    }
-
-    h = (bufhdr_t *) ((char *) cmpl->xfc - offsetof(bufhdr_t, xfc));
-    h->nused = cmpl->len;
-
-    if (cmpl != NULL && cmpl->xfc != &head->xfc) {
-        hlog_fast(
-            ooo, "%s: out-of-order completion: context %p at head, received %p",
-            __func__, (void *) &h->xfc.ctx, (void *) cmpl->xfc);
-    }
-
-out:
-    if (head == NULL || head->xfc.owner != xfo_program)
-        return NULL;
-
-    return fifo_get(rc->posted);
+    return global_state.batch && fifo_nempty(ctl->posted) > 1;
 }
 
 static void
-rxctl_post(cxn_t *c, rxctl_t *ctl, bufhdr_t *h)
+rxctl_multi_post(cxn_t *c, rxctl_t *ctl, bufhdr_t *h, bool more)
 {
     int rc;
 
     h->xfc.cancelled = 0;
     h->xfc.owner = xfo_nic;
 
-    const uint64_t tag = seqsource_get(&ctl->tags);
-
-    rc = fi_trecvmsg(
+    rc = fi_recvmsg(
         c->ep,
-        &(struct fi_msg_tagged){
+        &(struct fi_msg){
             .msg_iov =
                 &(struct iovec){.iov_base = &((bytebuf_t *) h)->payload[0],
                                 .iov_len = h->nallocated},
             .desc = &h->desc,
             .iov_count = 1,
             .addr = c->peer_addr,
-            .tag = tag & ~ctl->ignore,
-            .ignore = 0,
             .context = &h->xfc.ctx,
             .data = 0},
-        FI_COMPLETION);
+        FI_COMPLETION | FI_MULTI_RECV | (more ? FI_MORE : 0));
 
-    if (rc < 0) {
-        seqsource_unget(&ctl->tags, tag);
-        bailout_for_ofi_ret(rc, "fi_trecvmsg");
-    }
+    if (rc < 0)
+        bailout_for_ofi_ret(rc, "fi_recvmsg");
 
     (void) fifo_put(ctl->posted, h);
 }
 
+/* With -M, register and post the multi-receive buffers of `ctl`. */
 static void
-fifo_cancel(struct fid_ep *ep, fifo_t *posted)
+rxctl_multi_start(cxn_t *c, rxctl_t *ctl)
 {
-    bufhdr_t *first = NULL, *h;
+    size_t i;
     int rc;
 
-    while ((h = fifo_peek(posted)) != NULL) {
-        if (h == first)
-            break;
-        (void) fifo_get(posted);
-        if (first == NULL)
-            first = h;
-        h->xfc.cancelled = 1;
-        if ((rc = fi_cancel(&ep->fid, &h->xfc.ctx)) != 0)
-            bailout_for_ofi_ret(rc, "fi_cancel");
-        (void) fifo_put(posted, h);
-    }
-}
+    for (i = 0; i < multi_recv_nbufs; i++) {
+        bufhdr_t *h = buf_alloc(ctl->msglen * multi_recv_nmsgs);
 
-static buflist_t *
-buflist_create(size_t n)
-{
-    buflist_t *bl = malloc(offsetof(buflist_t, buf) + sizeof(bl->buf[0]) * n);
+        if (h == NULL) {
+            errx(EXIT_FAILURE, "%s: could not allocate a multi-receive buffer",
+                 __func__);
+        }
+
+        h->xfc.type = ctl->type;
+
+        rc = buf_mr_reg(global_state.domain, c->ep, FI_RECV,
+                        seqsource_get(&c->keys), h);
+
+        if (rc < 0)
+            bailout_for_ofi_ret(rc, "buffer memory registration failed");
+
+        rxctl_multi_post(c, ctl, h,
+                         global_state.batch && i + 1 < multi_recv_nbufs);
+    }
+}
+
+/* Remove buffer `h` from `ctl->posted`, keeping the rest in order.
+ * Usually `h` is at the head.
+ */
+static void
+rxctl_retire(rxctl_t *ctl, bufhdr_t *h)
+{
+    bufhdr_t *first;
+    size_t i;
+    bool found = false;
+
+    if (fifo_peek(ctl->posted) == h) {
+        (void) fifo_get(ctl->posted);
+        return;
+    }
+
+    for (i = fifo_nfull(ctl->posted); i > 0; i--) {
+        if ((first = fifo_get(ctl->posted)) == h)
+            found = true;
+        else
+            (void) fifo_put(ctl->posted, first);
+    }
+
+    if (!found) {
+        errx(EXIT_FAILURE, "%s: buffer %p was not posted", __func__,
+             (void *) h);
+    }
+}
+
+/* With -M, copy the message that `cmpl` reports out of its
+ * multi-receive buffer.  Repost the buffer if the provider released it.
+ * Return the copy, or NULL if `cmpl` reports no message.
+ */
+static bufhdr_t *
+rxctl_multi_complete(cxn_t *c, rxctl_t *ctl, const completion_t *cmpl)
+{
+    bufhdr_t *h = NULL, *mh;
+
+    if (cmpl == NULL)
+        return NULL;
+
+    mh = (bufhdr_t *) ((char *) cmpl->xfc - offsetof(bufhdr_t, xfc));
+
+    if (mh->xfc.cancelled) {
+        rxctl_retire(ctl, mh);
+        (void) buf_mr_dereg(mh);
+        buf_free(mh);
+        return NULL;
+    }
+
+    /* The provider may report the release of the buffer in a completion
+     * of its own, without a message.
+     */
+    if (cmpl->len > 0) {
+        if ((cmpl->flags & desired_rx_flags) != desired_rx_flags) {
+            errx(EXIT_FAILURE,
+                 "%s: expected flags %" PRIu64 ", received flags %" PRIu64,
+                 __func__, desired_rx_flags, cmpl->flags & desired_rx_flags);
+        }
+        if ((h = buflist_get(ctl->pool)) == NULL &&
+            (h = buf_alloc(ctl->msglen)) == NULL) {
+            errx(EXIT_FAILURE, "%s: could not allocate a message buffer",
+                 __func__);
+        }
+        h->xfc.type = ctl->type;
+        h->xfc.owner = xfo_program;
+        h->xfc.cancelled = 0;
+        /* A message too long for `h` is truncated, but `nused` keeps
+         * its length, so that the well-formedness checks reject it.
+         */
+        memcpy(&((bytebuf_t *) h)->payload[0], cmpl->buf,
+               minsize(cmpl->len, h->nallocated));
+        h->nused = cmpl->len;
+    }
+
+    if ((cmpl->flags & FI_MULTI_RECV) != 0) {
+        rxctl_retire(ctl, mh);
+        if (c->cancelled || c->ended) {
+            (void) buf_mr_dereg(mh);
+            buf_free(mh);
+        } else {
+            rxctl_multi_post(c, ctl, mh, false);
+        }
+    }
+
+    return h;
+}
+
+/* Return the buffer that holds the message `cmpl` reports, or NULL if
+ * there is none.  Messages come back in the order they arrived, which
+ * need not be the order of the posted receives.  Their sequence
+ * numbers restore the protocol order where it matters.
+ */
+static bufhdr_t *
+rxctl_complete(cxn_t *c, rxctl_t *rc, const completion_t *cmpl)
+{
+    bufhdr_t *h, *head;
+
+    if (global_state.multi_recv)
+        return rxctl_multi_complete(c, rc, cmpl);
+
+    if (cmpl == NULL)
+        return NULL;
+
+    if ((head = fifo_peek(rc->posted)) == NULL) {
+        errx(EXIT_FAILURE, "%s: received a completion, but no Rx was posted",
+             __func__);
+    }
+
+    cmpl->xfc->owner = xfo_program;
+
+    if (cmpl->xfc->cancelled) {
+        ; /* do nothing; leave cancelled flag set, it's needed by
+           * higher-level processing---e.g., in xmtr_vector_rx_process
+           */
+    } else if ((cmpl->flags & desired_tagged_rx_flags) !=
+               desired_tagged_rx_flags) {
+        char difference[128];
+
+        errx(EXIT_FAILURE,
+             "%s: expected flags %" PRIu64
+             " differs from received flags %" PRIu64 " at %s",
+             __func__, desired_tagged_rx_flags,
+             cmpl->flags & desired_tagged_rx_flags,
+             completion_flags_to_string(
+                 desired_tagged_rx_flags ^
+                     (cmpl->flags & desired_tagged_rx_flags),
+                 difference, sizeof(difference)));
+    }
+
+    h = (bufhdr_t *) ((char *) cmpl->xfc - offsetof(bufhdr_t, xfc));
+    h->nused = cmpl->len;
+
+    if (h != head) {
+        hlog_fast(
+            ooo, "%s: out-of-order completion: context %p at head, received %p",
+            __func__, (void *) &head->xfc.ctx, (void *) cmpl->xfc);
+    }
+
+    rxctl_retire(rc, h);
+
+    return h;
+}
+
+static void
+rxctl_post(cxn_t *c, rxctl_t *ctl, bufhdr_t *h, bool more)
+{
+    int rc;
+
+    h->xfc.cancelled = 0;
+    h->xfc.owner = xfo_nic;
+
+    const uint64_t tag = seqsource_get(&ctl->tags);
+
+    rc = fi_trecvmsg(
+        c->ep,
+        &(struct fi_msg_tagged){
+            .msg_iov =
+                &(struct iovec){.iov_base = &((bytebuf_t *) h)->payload[0],
+                                .iov_len = h->nallocated},
+            .desc = &h->desc,
+            .iov_count = 1,
+            .addr = c->peer_addr,
+            .tag = tag & ~ctl->ignore,
+            .ignore = 0,
+            .context = &h->xfc.ctx,
+            .data = 0},
+        FI_COMPLETION | (more ? FI_MORE : 0));
+
+    if (rc < 0) {
+        seqsource_unget(&ctl->tags, tag);
+        bailout_for_ofi_ret(rc, "fi_trecvmsg");
+    }
+
+    (void) fifo_put(ctl->posted, h);
+}
+
+/* Return a buffer that held a received message to `ctl`: repost it,
+ * or, with -M, put it back in the pool.
+ */
+static void
+rxctl_recycle(cxn_t *c, rxctl_t *ctl, bufhdr_t *h)
+{
+    if (!global_state.multi_recv)
+        rxctl_post(c, ctl, h, false);
+    else if (!buflist_put(ctl->pool, h))
+        buf_free(h);
+}
+
+static void
+fifo_cancel(struct fid_ep *ep, fifo_t *posted)
+{
+    bufhdr_t *first = NULL, *h;
+    int rc;
+
+    while ((h = fifo_peek(posted)) != NULL) {
+        if (h == first)
+            break;
+        (void) fifo_get(posted);
+        if (first == NULL)
+            first = h;
+        h->xfc.cancelled = 1;
+        if ((rc = fi_cancel(&ep->fid, &h->xfc.ctx)) != 0)
+            bailout_for_ofi_ret(rc, "fi_cancel");
+        (void) fifo_put(posted, h);
+    }
+}
+
+static buflist_t *
+buflist_create(size_t n)
+{
+    buflist_t *bl = malloc(offsetof(buflist_t, buf) + sizeof(bl->buf[0]) * n);
 
     if (bl == NULL)
         return NULL;
@@ -1383,12 +2223,18 @@ buflist_create(size_t n)
 }
 
 static void
-rxctl_init(rxctl_t *ctl, size_t len)
+rxctl_init(rxctl_t *ctl, size_t len, xfc_type_t type, size_t msglen)
 {
     assert(size_is_power_of_2(len));
 
     seqsource_init(&ctl->tags);
     ctl->ignore = ~(uint64_t) (len - 1);
+    ctl->type = type;
+    ctl->msglen = msglen;
+
+    if (global_state.multi_recv && (ctl->pool = buflist_create(len)) == NULL)
+        errx(EXIT_FAILURE, "%s: could not create message buffer pool",
+             __func__);
 
     if ((ctl->posted = fifo_create(len)) == NULL) {
         errx(EXIT_FAILURE, "%s: could not create posted messages FIFO",
@@ -1434,6 +2280,8 @@ txctl_init(txctl_t *ctl, size_t len, size_t nbufs,
 
     seqsource_init(&ctl->tags);
     ctl->ignore = ~(uint64_t) (len - 1);
+    ctl->nextseq = 0;
+    ctl->more_pending = false;
 
     if ((ctl->ready = fifo_create(len)) == NULL) {
         errx(EXIT_FAILURE, "%s: could not create ready messages FIFO",
@@ -1478,21 +2326,20 @@ txctl_complete(txctl_t *tc, const completion_t *cmpl)
 {
     bufhdr_t *h;
 
+    const uint64_t desired = global_state.multi_recv ? desired_tx_flags
+                                                     : desired_tagged_tx_flags;
+
     if (cmpl->xfc->cancelled) {
         cmpl->xfc->cancelled = 0;
-    } else if ((cmpl->flags & desired_tagged_tx_flags) !=
-               desired_tagged_tx_flags) {
+    } else if ((cmpl->flags & desired) != desired) {
         char difference[128];
 
         errx(EXIT_FAILURE,
              "%s: expected flags %" PRIu64
              " differs from received flags %" PRIu64 " at %s",
-             __func__, desired_tagged_tx_flags,
-             cmpl->flags & desired_tagged_tx_flags,
-             completion_flags_to_string(
-                 desired_tagged_tx_flags ^
-                     (cmpl->flags & desired_tagged_tx_flags),
-                 difference, sizeof(difference)));
+             __func__, desired, cmpl->flags & desired,
+             completion_flags_to_string(desired ^ (cmpl->flags & desired),
+                                        difference, sizeof(difference)));
     }
 
     if ((h = fifo_get(tc->posted)) == NULL) {
@@ -1516,11 +2363,13 @@ static void
 txctl_transmit(cxn_t *c, txctl_t *tc)
 {
     bufhdr_t *h;
-    size_t nsent = 0;
+    size_t nbatch, nsent = 0;
 
     /* Periodically induce an out-of-order message transmission by
      * "rotating" the tx-ready FIFO: if more than one buffer is on the
      * FIFO, then move the buffer at the front of the FIFO to the back.
+     * The receiver puts vectors and progress messages back in order by
+     * their sequence numbers, tagged or not, so rotate with -M, too.
      */
     if (tc->rotate_ready_countdown == 0) {
         if (fifo_nfull(tc->ready) > 1 && fifo_nempty(tc->posted) > 1) {
@@ -1531,31 +2380,60 @@ txctl_transmit(cxn_t *c, txctl_t *tc)
         tc->rotate_ready_countdown--;
     }
 
+    /* With batching, size the batch by the messages already queued and
+     * the transmissions that may be outstanding, and set FI_MORE on all
+     * but the last transmission in it.  If the provider deferred a
+     * transmission in the middle of the last batch, that batch is still
+     * open: the message that it deferred is still ready, so close the
+     * batch by posting the first message without FI_MORE.
+     */
+    nbatch = global_state.batch
+                 ? minsize(fifo_nfull(tc->ready), fifo_nempty(tc->posted))
+                 : 0;
+
     while ((h = fifo_peek(tc->ready)) != NULL && txctl_ready(tc)) {
-        const int rc = fi_tsendmsg(
-            c->ep,
-            &(struct fi_msg_tagged){
-                .msg_iov =
-                    &(struct iovec){.iov_base = &((bytebuf_t *) h)->payload[0],
-                                    .iov_len = h->nused},
-                .desc = h->desc,
-                .iov_count = 1,
-                .addr = c->peer_addr,
-                .tag = h->tag & ~tc->ignore,
-                .ignore = 0,
-                .context = &h->xfc.ctx,
-                .data = 0},
-            FI_COMPLETION);
+        const bool more = !tc->more_pending && nsent + 1 < nbatch;
+        const uint64_t flags = FI_COMPLETION | tc->flags | (more ? FI_MORE : 0);
+        struct iovec iov = {.iov_base = &((bytebuf_t *) h)->payload[0],
+                            .iov_len = h->nused};
+        int rc;
+
+        if (global_state.multi_recv) {
+            rc = fi_sendmsg(c->ep,
+                            &(struct fi_msg){.msg_iov = &iov,
+                                             .desc = &h->desc,
+                                             .iov_count = 1,
+                                             .addr = c->peer_addr,
+                                             .context = &h->xfc.ctx,
+                                             .data = 0},
+                            flags);
+        } else {
+            rc = fi_tsendmsg(c->ep,
+                             &(struct fi_msg_tagged){
+                                 .msg_iov = &iov,
+                                 .desc = h->desc,
+                                 .iov_count = 1,
+                                 .addr = c->peer_addr,
+                                 .tag = h->tag & ~tc->ignore,
+                                 .ignore = 0,
+                                 .context = &h->xfc.ctx,
+                                 .data = 0},
+                             flags);
+        }
 
         if (rc == 0) {
             (void) fifo_get(tc->ready);
             (void) fifo_put(tc->posted, h);
             nsent++;
+            tc->more_pending = more;
+            counter_add(&c->stats->nctlmsgs, 1);
         } else if (rc == -FI_EAGAIN) {
             hlog_fast(txdefer, "%s: deferred transmission", __func__);
             break;
         } else if (rc < 0) {
-            bailout_for_ofi_ret(rc, "fi_tsendmsg");
+            bailout_for_ofi_ret(rc, "%s",
+                                global_state.multi_recv ? "fi_sendmsg"
+                                                        : "fi_tsendmsg");
         }
     }
     if (nsent > 1)
@@ -1569,13 +2447,23 @@ rcvr_start(worker_t *w, rcvr_t *r, fifo_t *ready_for_cxn)
 
     r->cxn.started = true;
 
-    while (rxctl_ready(&r->progress)) {
+    if (global_state.multi_recv)
+        rxctl_multi_start(&r->cxn, &r->progress);
+
+    while (!global_state.multi_recv && rxctl_ready(&r->progress)) {
         progbuf_t *pb = progbuf_alloc();
 
-        rxctl_post(&r->cxn, &r->progress, &pb->hdr);
+        rxctl_post(&r->cxn, &r->progress, &pb->hdr,
+                   rxctl_more(&r->progress));
     }
 
-    for (nleftover = sizeof(txbuf), nloaded = 0; nleftover > 0;) {
+    /* A file sink keeps many writes in flight, so give the session as
+     * many buffers as the FIFO holds.  Otherwise, buffers for
+     * `sizeof(txbuf)` bytes are enough to start with.
+     */
+    for (nleftover = sizeof(txbuf), nloaded = 0;
+         (global_state.file_path != NULL) ? !fifo_full(ready_for_cxn)
+                                          : nleftover > 0;) {
         bytebuf_t *b = worker_payload_rxbuf_get(w, r->cxn.ep);
 
         if (b == NULL) {
@@ -1595,6 +2483,86 @@ rcvr_start(worker_t *w, rcvr_t *r, fifo_t *ready_for_cxn)
     return loop_continue;
 }
 
+/* Advance the SplitMix64 generator at `state` and return its next
+ * output.
+ */
+static uint64_t
+splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/* Return a uniform random number in (0, 1]. */
+static double
+source_unit(source_t *s)
+{
+    return (double) ((splitmix64(&s->rng) >> 11) + 1) * 0x1.0p-53;
+}
+
+/* Return the number of bytes to put in the next buffer, `h`. */
+static size_t
+source_size(source_t *s, const bufhdr_t *h)
+{
+    const double two_pi = 6.283185307179586;
+    size_t size, lo, hi;
+    uint64_t r;
+
+    switch (global_state.sizes.dist) {
+        case sd_fixed:
+            size = global_state.sizes.a;
+            break;
+        case sd_uniform:
+            size = global_state.sizes.a +
+                   splitmix64(&s->rng) %
+                       (global_state.sizes.b - global_state.sizes.a + 1);
+            break;
+        case sd_bimodal:
+            size = (source_unit(s) <= global_state.sizes.p)
+                       ? global_state.sizes.a
+                       : global_state.sizes.b;
+            break;
+        case sd_lognormal: {
+            /* Box-Muller.  Draw the two uniforms in separate
+             * statements, so that the order of the draws, and with it
+             * the sequence for a given seed, does not depend on the
+             * compiler.
+             */
+            const double u1 = source_unit(s);
+            const double u2 = source_unit(s);
+            const double z = sqrt(-2 * log(u1)) * cos(two_pi * u2);
+            const double x = (double) global_state.sizes.a *
+                             exp(global_state.sizes.sigma * z);
+
+            size = (x < (double) global_state.sizes.max)
+                       ? (size_t) x
+                       : global_state.sizes.max;
+            break;
+        }
+        case sd_hist:
+            r = splitmix64(&s->rng) %
+                global_state.sizes.bin[global_state.sizes.nbins - 1].cum;
+            for (lo = 0, hi = global_state.sizes.nbins - 1; lo < hi;) {
+                const size_t mid = lo + (hi - lo) / 2;
+
+                if (r < global_state.sizes.bin[mid].cum)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            size = global_state.sizes.bin[lo].size;
+            break;
+        case sd_buffer:
+        default:
+            return h->nallocated;
+    }
+
+    return (size == 0) ? 1 : minsize(size, h->nallocated);
+}
+
 /* Return `loop_continue` if the source is producing more bytes, `loop_end` if
  * the source will produce no more bytes.
  */
@@ -1611,12 +2579,14 @@ source_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
         bytebuf_t *b = (bytebuf_t *) h;
         size_t len, ofs;
 
-        if (s->idx == s->entirelen) {
+        if (s->idx == s->entirelen ||
+            atomic_load_explicit(&global_state.duration.over,
+                                 memory_order_relaxed)) {
             fifo_put_close(completed);
             break;
         }
 
-        h->nused = minsize(s->entirelen - s->idx, h->nallocated);
+        h->nused = minsize(s->entirelen - s->idx, source_size(s, h));
         for (ofs = 0; ofs < h->nused; ofs += len) {
             size_t txbuf_ofs = (s->idx + ofs) % s->txbuflen;
             len = minsize(h->nused - ofs, s->txbuflen - txbuf_ofs);
@@ -1649,6 +2619,16 @@ sink_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
     if (fifo_eoget(ready)) {
         if (!fifo_alt_empty(ready))
             goto fail;
+        /* The receiver closes `ready` after the transmitter's last
+         * byte, so a stream that ends short of `entirelen` arrives
+         * here.  Without -D, where the stream may end anywhere, that is
+         * a truncated payload, not a clean end.
+         */
+        if (global_state.duration.length == 0 && s->idx != s->entirelen) {
+            hlog_fast(payverify, "%s: stream ended after %zu of %zu bytes",
+                      __func__, s->idx, s->entirelen);
+            return loop_error;
+        }
         return loop_end;
     }
 
@@ -1674,77 +2654,1065 @@ sink_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
     if (s->idx != s->entirelen)
         return loop_continue;
 
-    fifo_get_close(ready);
+    if (!fifo_eoget(ready))
+        fifo_get_close(ready);
     return loop_end;
 fail:
     hlog_fast(payverify, "unexpected received payload");
     return loop_error;
 }
 
+/* Return true if `fd` is ready for `events`, without waiting.  Return
+ * false if it is not ready or on an error.
+ */
 static bool
-progbuf_is_wellformed(progbuf_t *pb)
+stream_ready(int fd, short events)
 {
-    return pb->hdr.nused == sizeof(pb->msg);
+    struct pollfd pfd = {.fd = fd, .events = events, .revents = 0};
+
+    return poll(&pfd, 1, 0) == 1;
 }
 
-/* Process completion vector-message reception.  Return 0 if no
- * completions occurred, 1 if any completion occurred, -1 on an
- * irrecoverable error.
+/* Read standard input into the empty buffers on `ready`, filling many
+ * buffers with one system call, and pass the buffers to `completed`.
+ * Close `completed` at the end of input.  Return `loop_continue` if
+ * the source is producing more bytes, `loop_end` if the source will
+ * produce no more bytes, `loop_error` on a read error.
  */
-static int
-rcvr_progress_rx_process(rcvr_t *r, bufhdr_t *h)
+static loop_control_t
+stream_source_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
 {
-    progbuf_t *pb = (progbuf_t *) h;
+    stream_terminal_t *st = (stream_terminal_t *) t;
+    struct iovec iov[STREAM_IOVS_MAX];
+    bufhdr_t *h;
+    ssize_t nread;
+    size_t n;
 
-    if (h->xfc.cancelled) {
-        buf_free(h);
-        return 0;
-    }
+    if (fifo_eoput(completed))
+        return loop_end;
 
-    if (!progbuf_is_wellformed(pb)) {
-        rxctl_post(&r->cxn, &r->progress, h);
-        return 0;
+    for (n = 0; n < arraycount(iov) && n < fifo_nempty(completed) &&
+                (h = fifo_alt_peek_at(ready, n)) != NULL;
+         n++) {
+        iov[n] = (struct iovec){.iov_base = ((bytebuf_t *) h)->payload,
+                                .iov_len = h->nallocated};
     }
 
-    hlog_fast(msg,
-              "%s: received progress message, %" PRIu64
-              " bytes filled, %" PRIu64 " bytes leftover.",
-              __func__, pb->msg.nfilled, pb->msg.nleftover);
+    if (n == 0)
+        return loop_continue;
 
-    r->nfull += pb->msg.nfilled;
+    if (st->pipe) {
+        nread = vmsplice(st->fd, iov, n, SPLICE_F_NONBLOCK);
+    } else if (stream_ready(st->fd, POLLIN)) {
+        nread = readv(st->fd, iov, (int) n);
+    } else {
+        return loop_continue;
+    }
 
-    if (pb->msg.nleftover == 0) {
-        hlog_fast(proto_progress, "%s: received remote EOF", __func__);
-        r->cxn.eof.remote = true;
+    if (nread == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return loop_continue;
+        hlog_fast(err, "%s: read: %s", __func__, strerror(errno));
+        return loop_error;
+    }
+
+    if (nread == 0) {
+        fifo_put_close(completed);
+        return loop_end;
     }
 
-    rxctl_post(&r->cxn, &r->progress, h);
+    while (nread > 0) {
+        h = fifo_get(ready);
+        h->nused = minsize((size_t) nread, h->nallocated);
+        nread -= (ssize_t) h->nused;
+        (void) fifo_alt_put(completed, h);
+    }
 
-    return 1;
+    return loop_continue;
 }
 
-/* Process completions.  Return 0 if no completions occurred, 1 if
- * any completion occurred, -1 on an irrecoverable error.
+/* Write the buffers on `ready` to standard output, many buffers with
+ * one system call, and pass each buffer to `completed` when all of its
+ * bytes are written.  Return `loop_continue` if the sink is accepting
+ * more bytes, `loop_end` after the last byte is written, `loop_error`
+ * on a write error.
  */
-static int
-rcvr_cq_process(rcvr_t *r)
+static loop_control_t
+stream_sink_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
 {
-    struct fi_cq_msg_entry fcmpl;
-    completion_t cmpl, *cmplp;
+    stream_terminal_t *st = (stream_terminal_t *) t;
+    struct iovec iov[STREAM_IOVS_MAX];
     bufhdr_t *h;
-    size_t nprocessed;
-    ssize_t ncompleted;
+    ssize_t nwritten;
+    size_t n, ofs;
 
-    if ((ncompleted = fi_cq_read(r->cxn.cq, &fcmpl, 1)) == -FI_EAGAIN)
-        return 0;
+    if (fifo_eoget(ready))
+        return loop_end;
 
-    if (ncompleted == -FI_EAVAIL) {
-        struct fi_cq_err_entry e;
-        char errbuf[256];
-        char flagsbuf[2][256];
-        ssize_t nfailed = fi_cq_readerr(r->cxn.cq, &e, 0);
+    for (n = 0, ofs = st->ofs; n < arraycount(iov) &&
+                               n < fifo_nempty(completed) &&
+                               (h = fifo_alt_peek_at(ready, n)) != NULL;
+         n++, ofs = 0) {
+        iov[n] = (struct iovec){
+            .iov_base = &((bytebuf_t *) h)->payload[ofs],
+            .iov_len = h->nused - ofs};
+    }
 
-        cmpl = (completion_t){.xfc = e.op_context, .len = 0, .flags = 0};
+    if (n == 0)
+        return loop_continue;
+
+    /* vmsplice(2) would lend the buffers' pages to the pipe, but each
+     * buffer goes back to the connection to be overwritten as soon as
+     * it is passed on, so copy.  POLLOUT only promises room for
+     * PIPE_BUF bytes, but `fd` is non-blocking, so a longer write stops
+     * short instead of stalling the worker.
+     */
+    if (!stream_ready(st->fd, POLLOUT))
+        return loop_continue;
+
+    nwritten = writev(st->fd, iov, (int) n);
+
+    if (nwritten == -1) {
+        if (errno == EAGAIN || errno == EINTR)
+            return loop_continue;
+        hlog_fast(err, "%s: write: %s", __func__, strerror(errno));
+        return loop_error;
+    }
+
+    /* Pass on every buffer that is completely written, including any
+     * empty ones at the end.
+     */
+    while ((h = fifo_peek(ready)) != NULL &&
+           h->nused - st->ofs <= (size_t) nwritten) {
+        nwritten -= (ssize_t) (h->nused - st->ofs);
+        st->ofs = 0;
+        (void) fifo_get(ready);
+        (void) fifo_put(completed, h);
+    }
+    st->ofs += (size_t) nwritten;
+
+    return fifo_eoget(ready) ? loop_end : loop_continue;
+}
+
+/* Set up ring `u` with room for `depth` submissions.  The kernel may
+ * round `depth` up.
+ */
+static void
+uring_init(uring_t *u, unsigned depth)
+{
+    struct io_uring_params params;
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_SHARED | MAP_POPULATE;
+
+    memset(u, 0, sizeof(*u));
+    memset(&params, 0, sizeof(params));
+
+    u->fd = (int) syscall(SYS_io_uring_setup, depth, &params);
+    if (u->fd == -1)
+        err(EXIT_FAILURE, "%s: io_uring_setup", __func__);
+
+    u->depth = params.sq_entries;
+    u->sq.ringlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->sq.sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->cq.ringlen = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+
+    u->sq.ring = mmap(NULL, u->sq.ringlen, prot, flags, u->fd,
+                      IORING_OFF_SQ_RING);
+    u->sq.sqes = mmap(NULL, u->sq.sqeslen, prot, flags, u->fd,
+                      IORING_OFF_SQES);
+    u->cq.ring = mmap(NULL, u->cq.ringlen, prot, flags, u->fd,
+                      IORING_OFF_CQ_RING);
+
+    if (u->sq.ring == MAP_FAILED || u->sq.sqes == MAP_FAILED ||
+        u->cq.ring == MAP_FAILED)
+        err(EXIT_FAILURE, "%s: mmap", __func__);
+
+    char *sq = u->sq.ring, *cq = u->cq.ring;
+
+    u->sq.head = (unsigned *) (sq + params.sq_off.head);
+    u->sq.tail = (unsigned *) (sq + params.sq_off.tail);
+    u->sq.mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    u->sq.array = (unsigned *) (sq + params.sq_off.array);
+    u->cq.head = (unsigned *) (cq + params.cq_off.head);
+    u->cq.tail = (unsigned *) (cq + params.cq_off.tail);
+    u->cq.mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    u->cq.cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+}
+
+static void
+uring_destroy(uring_t *u)
+{
+    if (munmap(u->sq.ring, u->sq.ringlen) == -1 ||
+        munmap(u->sq.sqes, u->sq.sqeslen) == -1 ||
+        munmap(u->cq.ring, u->cq.ringlen) == -1)
+        hlog_fast(leak, "%s: munmap: %s", __func__, strerror(errno));
+
+    if (close(u->fd) == -1)
+        hlog_fast(leak, "%s: close: %s", __func__, strerror(errno));
+}
+
+/* Queue a `len`-byte read or write (`opcode`) at `offset` in `fd`.
+ * The fixed-buffer opcodes use registered buffer `buf_index`; the
+ * others ignore it.  The caller must not exceed `u->depth` entries in
+ * flight.
+ */
+static void
+uring_prep(uring_t *u, uint8_t opcode, int fd, void *buf, size_t len,
+           uint64_t offset, unsigned buf_index, void *context)
+{
+    const unsigned tail = *u->sq.tail;
+    const unsigned i = tail & *u->sq.mask;
+    struct io_uring_sqe *sqe = &u->sq.sqes[i];
+
+    assert(u->ninflight < u->depth);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = (uint32_t) len;
+    sqe->off = offset;
+    sqe->buf_index = (uint16_t) buf_index;
+    sqe->user_data = (uint64_t) (uintptr_t) context;
+    u->sq.array[i] = i;
+
+    /* Publish the entry before the kernel can see the new tail. */
+    atomic_store_explicit((_Atomic unsigned *) u->sq.tail, tail + 1,
+                          memory_order_release);
+    u->nqueued++;
+    u->ninflight++;
+}
+
+/* Hand the kernel every queued entry.  Return 0 on success, even if
+ * the kernel was too busy to take them all, -1 on an irrecoverable
+ * error.
+ */
+static int
+uring_submit(uring_t *u)
+{
+    if (u->nqueued == 0)
+        return 0;
+
+    const long rc =
+        syscall(SYS_io_uring_enter, u->fd, u->nqueued, 0, 0, NULL, 0);
+
+    if (rc == -1) {
+        if (errno == EAGAIN || errno == EBUSY || errno == EINTR)
+            return 0;
+        hlog_fast(err, "%s: io_uring_enter: %s", __func__, strerror(errno));
+        return -1;
+    }
+
+    u->nqueued -= (unsigned) rc;
+    return 0;
+}
+
+/* Copy the next completion to `cqe` and return true, or return false if
+ * there are no completions.
+ */
+static bool
+uring_reap(uring_t *u, struct io_uring_cqe *cqe)
+{
+    const unsigned head = *u->cq.head;
+
+    if (head == atomic_load_explicit((_Atomic unsigned *) u->cq.tail,
+                                     memory_order_acquire))
+        return false;
+
+    *cqe = u->cq.cqes[head & *u->cq.mask];
+    atomic_store_explicit((_Atomic unsigned *) u->cq.head, head + 1,
+                          memory_order_release);
+    u->ninflight--;
+
+    return true;
+}
+
+/* Record the outcome of each read or write that completed.  A buffer
+ * goes back to the program when its I/O is done.  Return 0 on success,
+ * -1 if any I/O failed.
+ */
+static int
+file_terminal_reap(file_terminal_t *f, bool reading)
+{
+    struct io_uring_cqe cqe;
+
+    while (uring_reap(&f->ring, &cqe)) {
+        bufhdr_t *h = (bufhdr_t *) (uintptr_t) cqe.user_data;
+
+        h->xfc.owner = xfo_program;
+
+        if (cqe.res < 0) {
+            hlog_fast(err, "%s: %s: %s", __func__, reading ? "read" : "write",
+                      strerror(-cqe.res));
+            return -1;
+        }
+        if (reading) {
+            h->nused = (size_t) cqe.res;
+        } else if ((size_t) cqe.res != h->nused) {
+            hlog_fast(err, "%s: short write, %d of %zu bytes", __func__,
+                      cqe.res, h->nused);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Remember the payload of buffer `h`, if it is new, so that the next
+ * registration includes it.
+ */
+static void
+file_fixed_note(file_terminal_t *f, bufhdr_t *h)
+{
+    void *payload = ((bytebuf_t *) h)->payload;
+    size_t i;
+
+    for (i = 0; i < f->fixed.n; i++) {
+        if (f->fixed.iov[i].iov_base == payload)
+            return;
+    }
+    if (f->fixed.n < FILE_FIXED_MAX) {
+        f->fixed.iov[f->fixed.n++] =
+            (struct iovec){.iov_base = payload, .iov_len = h->nallocated};
+    }
+}
+
+/* Register the buffers on `ready` and `completed`, together with every
+ * buffer registered before, if any of them is new.  The registered
+ * buffers can only change while no I/O is in flight, so do nothing
+ * unless the ring is idle: that is always true at the first trade,
+ * when the session's buffers are gathered on the two FIFOs, and
+ * usually true again soon after.  If the kernel refuses to pin the
+ * buffers, say for RLIMIT_MEMLOCK, use unregistered buffers from then
+ * on.
+ */
+static void
+file_fixed_register(file_terminal_t *f, fifo_t *ready, fifo_t *completed)
+{
+    bufhdr_t *h;
+    size_t i;
+
+    if (!f->fixed.enabled || f->ring.ninflight != 0)
+        return;
+
+    for (i = 0; (h = fifo_alt_peek_at(ready, i)) != NULL; i++)
+        file_fixed_note(f, h);
+    for (i = 0; (h = fifo_alt_peek_at(completed, i)) != NULL; i++)
+        file_fixed_note(f, h);
+
+    if (f->fixed.nregistered == f->fixed.n)
+        return;
+
+    if (f->fixed.nregistered != 0 &&
+        syscall(SYS_io_uring_register, f->ring.fd, IORING_UNREGISTER_BUFFERS,
+                NULL, 0) == -1) {
+        hlog_fast(memreg, "%s: unregister buffers: %s", __func__,
+                  strerror(errno));
+        f->fixed.enabled = false;
+        return;
+    }
+    f->fixed.nregistered = 0;
+
+    if (syscall(SYS_io_uring_register, f->ring.fd, IORING_REGISTER_BUFFERS,
+                f->fixed.iov, (unsigned) f->fixed.n) == -1) {
+        hlog_fast(memreg, "%s: register buffers: %s", __func__,
+                  strerror(errno));
+        f->fixed.enabled = false;
+        return;
+    }
+    f->fixed.nregistered = f->fixed.n;
+}
+
+/* Queue a read (`reading` true) or a write of `len` bytes of buffer `h`
+ * at the file offset, using the fixed-buffer opcode if `h` is
+ * registered.
+ */
+static void
+file_terminal_prep(file_terminal_t *f, bool reading, bufhdr_t *h, size_t len)
+{
+    void *payload = ((bytebuf_t *) h)->payload;
+    uint8_t opcode = reading ? IORING_OP_READ : IORING_OP_WRITE;
+    size_t i;
+
+    for (i = 0; i < f->fixed.nregistered; i++) {
+        if (f->fixed.iov[i].iov_base == payload) {
+            opcode = reading ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            break;
+        }
+    }
+
+    h->xfc.owner = xfo_nic;
+    uring_prep(&f->ring, opcode, f->fd, payload, len, f->offset, (unsigned) i,
+               h);
+    f->offset += len;
+}
+
+/* Read the file into the empty buffers on `ready`, keeping several
+ * reads in flight, and pass the buffers to `completed` in file order.
+ * Close `completed` after the first short read.  Return `loop_continue`
+ * if the source is producing more bytes, `loop_end` if the source
+ * will produce no more bytes, `loop_error` on a read error.
+ */
+static loop_control_t
+file_source_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
+{
+    file_terminal_t *f = (file_terminal_t *) t;
+    bufhdr_t *h;
+
+    if (fifo_eoput(completed))
+        return loop_end;
+
+    if (file_terminal_reap(f, true) == -1)
+        return loop_error;
+
+    while (!f->eof && f->nsubmitted > 0 && (h = fifo_peek(ready)) != NULL &&
+           h->xfc.owner == xfo_program && !fifo_full(completed)) {
+        f->nsubmitted--;
+        if (h->nused < h->nallocated)
+            f->eof = true;
+        if (h->nused == 0)
+            break;
+        (void) fifo_get(ready);
+        (void) fifo_alt_put(completed, h);
+    }
+
+    /* Reads that were in flight past the end of the file leave their
+     * (empty) buffers on `ready`.
+     */
+    if (f->eof) {
+        if (f->ring.ninflight != 0)
+            return loop_continue;
+        f->nsubmitted = 0;
+        fifo_put_close(completed);
+        return loop_end;
+    }
+
+    file_fixed_register(f, ready, completed);
+
+    while (f->ring.ninflight < f->ring.depth &&
+           (h = fifo_alt_peek_at(ready, f->nsubmitted)) != NULL) {
+        file_terminal_prep(f, true, h, h->nallocated);
+        f->nsubmitted++;
+    }
+
+    if (uring_submit(&f->ring) == -1)
+        return loop_error;
+
+    return loop_continue;
+}
+
+/* Write the buffers on `ready` to the file in order, keeping several
+ * writes in flight, and pass each buffer to `completed` when its write
+ * is done.  Return `loop_continue` if the sink is accepting more
+ * bytes, `loop_end` after the last byte is written, `loop_error` on a
+ * write error.
+ */
+static loop_control_t
+file_sink_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
+{
+    file_terminal_t *f = (file_terminal_t *) t;
+    bufhdr_t *h;
+
+    if (fifo_eoget(ready))
+        return loop_end;
+
+    if (file_terminal_reap(f, false) == -1)
+        return loop_error;
+
+    while (f->nsubmitted > 0 && (h = fifo_peek(ready)) != NULL &&
+           h->xfc.owner == xfo_program && !fifo_full(completed)) {
+        f->nsubmitted--;
+        (void) fifo_get(ready);
+        (void) fifo_put(completed, h);
+    }
+
+    file_fixed_register(f, ready, completed);
+
+    while (f->ring.ninflight < f->ring.depth &&
+           (h = fifo_alt_peek_at(ready, f->nsubmitted)) != NULL) {
+        f->nsubmitted++;
+        if (h->nused == 0)
+            continue;
+        /* O_DIRECT needs whole pages at page offsets.  That holds until
+         * a short buffer, normally the last one, comes along; write
+         * through the page cache from then on.
+         */
+        if (f->direct && (h->nused % global_state.page_size != 0 ||
+                          f->offset % global_state.page_size != 0)) {
+            const int flags = fcntl(f->fd, F_GETFL);
+
+            if (flags == -1 ||
+                fcntl(f->fd, F_SETFL, flags & ~O_DIRECT) == -1) {
+                hlog_fast(err, "%s: fcntl: %s", __func__, strerror(errno));
+                return loop_error;
+            }
+            f->direct = false;
+        }
+        file_terminal_prep(f, false, h, h->nused);
+    }
+
+    if (uring_submit(&f->ring) == -1)
+        return loop_error;
+
+    return fifo_eoget(ready) ? loop_end : loop_continue;
+}
+
+/* Count the buffer.  `filter_trade` does the counting for every filter,
+ * so there is nothing else to do.
+ */
+static void
+filter_count_apply(filter_t transfer_unused *f, bufhdr_t transfer_unused *h)
+{
+}
+
+/* Add the buffer's payload to the running Adler-32 checksum of the
+ * stream.
+ */
+static void
+filter_adler32_apply(filter_t *f, bufhdr_t *h)
+{
+    const uint8_t *p = (const uint8_t *) ((bytebuf_t *) h)->payload;
+    uint32_t a = f->adler[0], b = f->adler[1];
+    size_t i, len, left;
+
+    /* 5552 is the most bytes that can be summed before the sums may
+     * overflow 32 bits.
+     */
+    for (left = h->nused; left > 0; left -= len) {
+        len = minsize(left, 5552);
+        for (i = 0; i < len; i++) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    f->adler[0] = a;
+    f->adler[1] = b;
+}
+
+/* The compressor's stream is a sequence of frames, one for each
+ * buffer from the source.  Each frame is an 8-byte header, holding the
+ * buffer's length and then the length of the frame body, both 32-bit
+ * little endian, and the body.  If the two lengths are equal, the body
+ * is the buffer, stored.  Otherwise it is LZ77 sequences in the LZ4
+ * block layout: a token byte with the literal count in its high nibble
+ * and the match length less `lz_min_match` in its low nibble, either
+ * nibble at 15 continued by bytes that add up to 255 each, the
+ * literals, and a 16-bit little-endian match offset.  The last
+ * sequence has literals only.
+ */
+#define LZ_HASH_BITS 12
+
+static const size_t lz_frame_header_len = 8;
+static const size_t lz_min_match = 4;
+
+static inline uint32_t
+lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline void
+lz_write32le(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static inline uint32_t
+lz_read32le(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+           ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Grow the `*sizep`-byte allocation at `*bufp` to hold `need` bytes. */
+static void
+lz_reserve(uint8_t **bufp, size_t *sizep, size_t need)
+{
+    uint8_t *buf;
+
+    if (need <= *sizep)
+        return;
+
+    if ((buf = realloc(*bufp, need)) == NULL)
+        err(EXIT_FAILURE, "%s: realloc", __func__);
+    *bufp = buf;
+    *sizep = need;
+}
+
+/* Write the bytes that continue a length nibble at 15. */
+static uint8_t *
+lz_length_put(uint8_t *op, size_t len)
+{
+    if (len < 15)
+        return op;
+    for (len -= 15; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+/* Write a sequence of `nlit` literals at `lit` and a match of `mlen`
+ * bytes `offset` back, or no match if `mlen` is 0, at `op`.  Return
+ * the end of the sequence, or NULL if it would pass `oend`.
+ */
+static uint8_t *
+lz_sequence_put(uint8_t *op, const uint8_t *oend, const uint8_t *lit,
+                size_t nlit, size_t offset, size_t mlen)
+{
+    const size_t mcode = (mlen == 0) ? 0 : mlen - lz_min_match;
+    const size_t need = 1 + nlit / 255 + 1 + nlit +
+                        ((mlen == 0) ? 0 : 2 + mcode / 255 + 1);
+
+    if (need > (size_t) (oend - op))
+        return NULL;
+
+    *op++ = (uint8_t) ((minsize(nlit, 15) << 4) | minsize(mcode, 15));
+    op = lz_length_put(op, nlit);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen != 0) {
+        *op++ = (uint8_t) offset;
+        *op++ = (uint8_t) (offset >> 8);
+        op = lz_length_put(op, mcode);
+    }
+    return op;
+}
+
+/* Compress the `n` bytes at `src` to at most `cap` bytes at `dst`.
+ * Return the compressed length, or 0 if it would exceed `cap`.
+ */
+static size_t
+lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap,
+            uint32_t *table)
+{
+    const uint8_t *ip = src, *anchor = src;
+    const uint8_t *const iend = src + n;
+    uint8_t *op = dst;
+    const uint8_t *const oend = dst + cap;
+
+    // `table` holds positions plus one, so 0 is empty.
+    memset(table, 0, sizeof(*table) << LZ_HASH_BITS);
+
+    while (n >= lz_min_match && ip <= iend - lz_min_match) {
+        const uint32_t v = lz_read32(ip), hash = lz_hash(v),
+                       pos = table[hash];
+        const uint8_t *ref;
+        size_t mlen;
+
+        table[hash] = (uint32_t) (ip - src) + 1;
+
+        if (pos == 0 || (ref = src + pos - 1, ip - ref > UINT16_MAX) ||
+            lz_read32(ref) != v) {
+            ip++;
+            continue;
+        }
+
+        for (mlen = lz_min_match; ip + mlen < iend && ref[mlen] == ip[mlen];
+             mlen++)
+            ; // do nothing
+
+        op = lz_sequence_put(op, oend, anchor, (size_t) (ip - anchor),
+                             (size_t) (ip - ref), mlen);
+        if (op == NULL)
+            return 0;
+        ip += mlen;
+        anchor = ip;
+    }
+
+    op = lz_sequence_put(op, oend, anchor, (size_t) (iend - anchor), 0, 0);
+
+    return (op == NULL) ? 0 : (size_t) (op - dst);
+}
+
+/* Read the bytes that continue a length nibble at 15, from `ip` up to
+ * `iend`, and add them to `*lenp`.  Return the end of the length, or
+ * NULL if it runs past `iend`.
+ */
+static const uint8_t *
+lz_length_get(const uint8_t *ip, const uint8_t *iend, size_t *lenp)
+{
+    uint8_t b;
+
+    if (*lenp < 15)
+        return ip;
+    do {
+        if (ip == iend)
+            return NULL;
+        b = *ip++;
+        *lenp += b;
+    } while (b == 255);
+    return ip;
+}
+
+/* Decompress the `n` bytes at `src` to exactly `cap` bytes at `dst`.
+ * Return false if the sequences are malformed, refer outside of
+ * `dst`, or do not decode to `cap` bytes.
+ */
+static bool
+lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *const iend = src + n;
+    uint8_t *op = dst;
+    const uint8_t *const oend = dst + cap;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        size_t nlit = token >> 4, mlen = token & 15, offset;
+
+        if ((ip = lz_length_get(ip, iend, &nlit)) == NULL ||
+            nlit > (size_t) (iend - ip) || nlit > (size_t) (oend - op))
+            return false;
+        memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+
+        // The last sequence has literals only.
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+
+        if ((ip = lz_length_get(ip, iend, &mlen)) == NULL)
+            return false;
+        mlen += lz_min_match;
+        if (offset == 0 || offset > (size_t) (op - dst) ||
+            mlen > (size_t) (oend - op))
+            return false;
+
+        // The match may overlap the bytes it produces, so copy bytewise.
+        for (; mlen > 0; mlen--, op++)
+            *op = op[-offset];
+    }
+
+    return op == oend;
+}
+
+/* Append a frame for the buffer's payload to the staged frames,
+ * compressed if that makes it shorter.
+ */
+static void
+filter_compress_apply(filter_t *f, bufhdr_t *h)
+{
+    const uint8_t *p = (const uint8_t *) ((bytebuf_t *) h)->payload;
+    uint8_t *frame, *body;
+    size_t bodylen;
+
+    lz_reserve(&f->lz.staged, &f->lz.size,
+               f->lz.len + lz_frame_header_len + h->nused);
+
+    frame = &f->lz.staged[f->lz.len];
+    body = frame + lz_frame_header_len;
+
+    if (h->nused == 0 ||
+        (bodylen = lz_compress(p, h->nused, body, h->nused - 1,
+                               f->lz.table)) == 0) {
+        memcpy(body, p, h->nused);
+        bodylen = h->nused;
+    }
+
+    lz_write32le(frame, (uint32_t) h->nused);
+    lz_write32le(frame + 4, (uint32_t) bodylen);
+    f->lz.len += lz_frame_header_len + bodylen;
+}
+
+/* Append the buffer's payload to the frame bytes not yet decoded, and
+ * decode each complete frame onto the staged bytes.  Set `lz.bad` if a
+ * frame does not decode.  No source buffer is larger than
+ * `source_size_max`, so neither is a frame's decoded length.
+ */
+static void
+filter_decompress_apply(filter_t *f, bufhdr_t *h)
+{
+    const uint8_t *p = (const uint8_t *) ((bytebuf_t *) h)->payload;
+    size_t ofs = 0;
+
+    lz_reserve(&f->lz.in, &f->lz.insize, f->lz.inlen + h->nused);
+    memcpy(&f->lz.in[f->lz.inlen], p, h->nused);
+    f->lz.inlen += h->nused;
+
+    while (f->lz.inlen - ofs >= lz_frame_header_len) {
+        const uint8_t *frame = &f->lz.in[ofs];
+        const uint8_t *body = frame + lz_frame_header_len;
+        const size_t rawlen = lz_read32le(frame),
+                     bodylen = lz_read32le(frame + 4);
+
+        if (f->lz.inlen - ofs - lz_frame_header_len < bodylen)
+            break;
+
+        if (rawlen > source_size_max || bodylen > rawlen) {
+            f->lz.bad = true;
+            break;
+        }
+
+        lz_reserve(&f->lz.staged, &f->lz.size, f->lz.len + rawlen);
+
+        if (bodylen == rawlen) {
+            memcpy(&f->lz.staged[f->lz.len], body, rawlen);
+        } else if (!lz_decompress(body, bodylen, &f->lz.staged[f->lz.len],
+                                  rawlen)) {
+            f->lz.bad = true;
+            break;
+        }
+
+        f->lz.len += rawlen;
+        ofs += lz_frame_header_len + bodylen;
+    }
+
+    memmove(f->lz.in, &f->lz.in[ofs], f->lz.inlen - ofs);
+    f->lz.inlen -= ofs;
+}
+
+static const struct {
+    const char *name;
+    void (*apply)(filter_t *, bufhdr_t *);
+    bool put, get; // the programs that may run the filter
+} filter_kinds[] = {{"adler32", filter_adler32_apply, true, true},
+                    {"compress", filter_compress_apply, true, false},
+                    {"count", filter_count_apply, true, true},
+                    {"decompress", filter_decompress_apply, false, true}};
+
+/* Apply the filter to each buffer on `ready` and pass it to
+ * `completed`.  Close `completed` after the last buffer on `ready`,
+ * and close `ready` if the next stage closes `completed` first.
+ * Return `loop_end` once `completed` is closed, otherwise
+ * `loop_continue`.
+ */
+static loop_control_t
+filter_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
+{
+    filter_t *f = (filter_t *) t;
+    const uint64_t begin = stage_clock();
+    bufhdr_t *h;
+
+    while ((h = fifo_peek(ready)) != NULL && !fifo_full(completed)) {
+        f->apply(f, h);
+        f->nbytes += h->nused;
+        f->nbufs++;
+        (void) fifo_get(ready);
+        (void) fifo_put(completed, h);
+    }
+
+    f->ticks += stage_clock() - begin;
+
+    if (fifo_eoget(ready) && !fifo_eoput(completed))
+        fifo_put_close(completed);
+    else if (fifo_eoput(completed) && !fifo_eoget(ready))
+        fifo_get_close(ready);
+
+    return fifo_eoput(completed) ? loop_end : loop_continue;
+}
+
+/* Move up to `h->nallocated` staged bytes into buffer `h` and pass
+ * it to `completed`.
+ */
+static void
+lz_emit(filter_t *f, bufhdr_t *h, fifo_t *completed)
+{
+    const size_t n = minsize(f->lz.len, h->nallocated);
+
+    memcpy(((bytebuf_t *) h)->payload, f->lz.staged, n);
+    memmove(f->lz.staged, &f->lz.staged[n], f->lz.len - n);
+    f->lz.len -= n;
+    h->nused = n;
+    f->nbytes_out += n;
+    (void) fifo_put(completed, h);
+}
+
+/* Compress or decompress each buffer on `ready` onto the staged bytes,
+ * and refill the buffer from them.  When a buffer's worth or more is
+ * left staged, as when the payload does not compress or when it
+ * expands, or when `ready` is through, carry the rest in spare buffers.
+ * Close `completed` once `ready` is through and nothing is staged.
+ * Return `loop_error` if a frame does not decode, or if `ready` ends
+ * inside a frame.
+ */
+static loop_control_t
+lz_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
+{
+    filter_t *f = (filter_t *) t;
+    const uint64_t begin = stage_clock();
+    bufhdr_t *h;
+
+    while (!f->lz.bad && !fifo_full(completed)) {
+        if ((h = fifo_peek(ready)) != NULL) {
+            f->apply(f, h);
+            f->nbytes += h->nused;
+            f->nbufs++;
+            if (h->nallocated > f->lz.bufsize)
+                f->lz.bufsize = h->nallocated;
+            (void) fifo_get(ready);
+            lz_emit(f, h, completed);
+            continue;
+        }
+        if (f->lz.len == 0 ||
+            (f->lz.len < f->lz.bufsize && !fifo_eoget(ready)))
+            break;
+        if ((h = fifo_get(f->lz.spares)) == NULL)
+            break;
+        lz_emit(f, h, completed);
+    }
+
+    f->ticks += stage_clock() - begin;
+
+    /* Staged bytes keep the session open, and busy, as a held buffer
+     * would.
+     */
+    t->nheld = (f->lz.len != 0 || f->lz.inlen != 0) ? 1 : 0;
+
+    if (f->lz.bad) {
+        hlog_fast(err, "%s: filter %s: a frame did not decode", __func__,
+                  f->name);
+        return loop_error;
+    }
+
+    if (fifo_eoget(ready) && f->lz.inlen != 0) {
+        hlog_fast(err, "%s: filter %s: the stream ended inside a frame",
+                  __func__, f->name);
+        return loop_error;
+    }
+
+    if (fifo_eoget(ready) && f->lz.len == 0 && !fifo_eoput(completed))
+        fifo_put_close(completed);
+    else if (fifo_eoput(completed) && !fifo_eoget(ready))
+        fifo_get_close(ready);
+
+    return fifo_eoput(completed) ? loop_end : loop_continue;
+}
+
+/* Trade at each stage in turn.  Return `loop_error` if any stage
+ * fails, `loop_end` if every stage is through, otherwise
+ * `loop_continue`.
+ */
+static loop_control_t
+chain_trade(terminal_t *t, fifo_t *ready, fifo_t *completed)
+{
+    chain_t *c = (chain_t *) t;
+    loop_control_t ctl = loop_end;
+    size_t i;
+
+    c->terminal.nheld = 0;
+
+    for (i = 0; i < global_state.filters.n; i++)
+        c->filter[i].lz.spares = c->sink ? completed : ready;
+
+    for (i = 0; i < c->nstages; i++) {
+        terminal_t *stage = c->stage[i];
+        fifo_t *in = (i == 0) ? ready : c->between[i - 1];
+        fifo_t *out = (i == c->nstages - 1) ? completed : c->between[i];
+
+        switch (stage->trade(stage, in, out)) {
+            case loop_error:
+                return loop_error;
+            case loop_end:
+                break;
+            default:
+                ctl = loop_continue;
+                break;
+        }
+        c->terminal.nheld += stage->nheld;
+    }
+
+    for (i = 0; i + 1 < c->nstages; i++)
+        c->terminal.nheld += fifo_nfull(c->between[i]);
+
+    return ctl;
+}
+
+static bool
+progbuf_is_wellformed(progbuf_t *pb)
+{
+    return pb->hdr.nused == sizeof(pb->msg);
+}
+
+/* Process completion vector-message reception.  Return 0 if no
+ * completions occurred, 1 if any completion occurred, -1 on an
+ * irrecoverable error.
+ */
+static int
+rcvr_progress_rx_process(rcvr_t *r, bufhdr_t *h)
+{
+    progbuf_t *pb = (progbuf_t *) h;
+
+    if (h->xfc.cancelled) {
+        buf_free(h);
+        return 0;
+    }
+
+    if (!progbuf_is_wellformed(pb)) {
+        rxctl_recycle(&r->cxn, &r->progress, h);
+        return 0;
+    }
+
+    hlog_fast(msg,
+              "%s: received progress message, %" PRIu64
+              " bytes filled, %" PRIu64 " bytes leftover.",
+              __func__, pb->msg.nfilled, pb->msg.nleftover);
+
+    /* The writes fill the targets in the order of `tgtposted`, so
+     * any progress adds to a filled prefix of them.
+     */
+    r->nfull += pb->msg.nfilled;
+    cxn_bytes_add(&r->cxn, pb->msg.nfilled);
+    counter_add(&r->cxn.stats->nctlmsgs, 1);
+
+    if (pb->msg.nleftover == 0) {
+        r->progseq.eof = true;
+        r->progseq.eofseq = pb->msg.seq;
+    }
+
+    r->progseq.nprocessed++;
+
+    if (r->progseq.eof && !r->cxn.eof.remote &&
+        r->progseq.nprocessed == r->progseq.eofseq + 1) {
+        hlog_fast(proto_progress, "%s: received remote EOF", __func__);
+        r->cxn.eof.remote = true;
+    }
+
+    rxctl_recycle(&r->cxn, &r->progress, h);
+
+    return 1;
+}
+
+/* Process completions.  Return 0 if no completions occurred, 1 if
+ * any completion occurred, -1 on an irrecoverable error.
+ */
+static int
+rcvr_cq_process(rcvr_t *r)
+{
+    struct fi_cq_data_entry fcmpl;
+    completion_t cmpl, *cmplp;
+    bufhdr_t *h;
+    size_t nprocessed;
+    ssize_t ncompleted;
+
+    if ((ncompleted = fi_cq_read(r->cxn.cq, &fcmpl, 1)) == -FI_EAGAIN)
+        return 0;
+
+    if (ncompleted == -FI_EAVAIL) {
+        struct fi_cq_err_entry e;
+        char errbuf[256];
+        char flagsbuf[2][256];
+        ssize_t nfailed = fi_cq_readerr(r->cxn.cq, &e, 0);
+
+        cmpl = (completion_t){.xfc = e.op_context, .len = 0, .flags = 0};
 
         if (e.err != FI_ECANCELED || !cmpl.xfc->cancelled) {
             hlog_fast(err, "%s: read %zd errors, %s", __func__, nfailed,
@@ -1767,19 +3735,24 @@ rcvr_cq_process(rcvr_t *r)
              ncompleted);
     } else {
         cmpl = (completion_t){
-            .xfc = fcmpl.op_context, .len = fcmpl.len, .flags = fcmpl.flags};
+            .xfc = fcmpl.op_context,
+            .len = fcmpl.len,
+            .buf = global_state.multi_recv ? fcmpl.buf : NULL,
+            .flags = fcmpl.flags};
         // fi_cancel races with completion, so it's not safe to
         // assert that the cancelled flag is false:
         // assert(!cmpl.xfc->cancelled);
     }
 
+    r->cxn.ncompletions++;
+
     switch (cmpl.xfc->type) {
         case xft_progress:
             hlog_fast(completion, "%s: read a progress rx completion",
                       __func__);
 
             for (nprocessed = 0, cmplp = &cmpl;
-                 (h = rxctl_complete(&r->progress, cmplp)) != NULL;
+                 (h = rxctl_complete(&r->cxn, &r->progress, cmplp)) != NULL;
                  cmplp = NULL) {
                 switch (rcvr_progress_rx_process(r, h)) {
                     case 1:
@@ -1804,6 +3777,55 @@ rcvr_cq_process(rcvr_t *r)
     }
 }
 
+/* Return true if `c` may issue an operation in this pass.  Without -q,
+ * the number of operations is not limited.
+ */
+static inline bool
+cxn_may_issue(const cxn_t *c)
+{
+    return global_state.weights.n == 0 || c->drr.deficit > 0;
+}
+
+/* Return true if `c` may issue another operation in this pass after
+ * the one it is issuing.
+ */
+static inline bool
+cxn_may_issue_another(const cxn_t *c)
+{
+    return global_state.weights.n == 0 || c->drr.deficit > 1;
+}
+
+/* With -q, give the `i`th session its weight. */
+static void
+cxn_weight_set(cxn_t *c, size_t i)
+{
+    if (global_state.weights.n != 0)
+        c->drr.weight = global_state.weights.w[i % global_state.weights.n];
+}
+
+static inline void
+cxn_issued(cxn_t *c)
+{
+    if (global_state.weights.n != 0)
+        c->drr.deficit--;
+}
+
+/* With -q, settle the deficit of `c` at the end of a pass.  A session
+ * with no work left forfeits what it did not spend, as in deficit
+ * round-robin.  A session that still has work, but could not issue it
+ * all, as when it ran out of RDMA targets, carries up to one pass's
+ * weight over, so that a stall does not cost it its share.  The cap
+ * keeps a long stall from turning into a burst.
+ */
+static inline void
+cxn_deficit_settle(cxn_t *c, bool backlogged)
+{
+    if (!backlogged)
+        c->drr.deficit = 0;
+    else if (c->drr.deficit > c->drr.weight)
+        c->drr.deficit = c->drr.weight;
+}
+
 static void
 rcvr_vector_update(fifo_t *ready_for_cxn, rcvr_t *r)
 {
@@ -1819,6 +3841,7 @@ rcvr_vector_update(fifo_t *ready_for_cxn, rcvr_t *r)
         memset(vb->msg.iov, 0, sizeof(vb->msg.iov));
         vb->msg.niovs = 0;
         vb->hdr.nused = (char *) &vb->msg.iov[0] - (char *) &vb->msg;
+        vb->msg.seq = r->vec.nextseq++;
         (void) txctl_put(&r->vec, &vb->hdr);
         r->cxn.eof.local = true;
         hlog_fast(proto_vector, "%s: rcvr %p enqueued local EOF", __func__,
@@ -1829,6 +3852,7 @@ rcvr_vector_update(fifo_t *ready_for_cxn, rcvr_t *r)
     }
 
     while (!fifo_full(r->vec.ready) && !fifo_empty(ready_for_cxn) &&
+           cxn_may_issue(&r->cxn) &&
            (vb = (vecbuf_t *) buflist_get(r->vec.pool)) != NULL) {
         size_t maxniovs;
 
@@ -1866,8 +3890,10 @@ rcvr_vector_update(fifo_t *ready_for_cxn, rcvr_t *r)
         }
         vb->msg.niovs = i;
         vb->hdr.nused = (char *) &vb->msg.iov[i] - (char *) &vb->msg;
+        vb->msg.seq = r->vec.nextseq++;
 
         (void) txctl_put(&r->vec, &vb->hdr);
+        cxn_issued(&r->cxn);
         hlog_fast(proto_vector, "%s: rcvr %p enqueued vector", __func__,
                   (void *) r);
     }
@@ -1909,6 +3935,15 @@ rcvr_targets_read(fifo_t *ready_for_terminal, rcvr_t *r)
 
         (void) fifo_alt_put(ready_for_terminal, h);
     }
+
+    /* After the remote's last byte has gone to the terminal, close
+     * `ready_for_terminal` so that a terminal that does not know the
+     * length of the stream can tell where it ends.
+     */
+    if (r->cxn.eof.remote && r->nfull == 0 &&
+        !fifo_eoput(ready_for_terminal) &&
+        ((h = fifo_peek(r->tgtposted)) == NULL || h->nused == 0))
+        fifo_put_close(ready_for_terminal);
 }
 
 static loop_control_t
@@ -1960,6 +3995,23 @@ rcvr_cancellation_complete(cxn_t *cxn)
     return rxctl_idle(&r->progress) && txctl_idle(&r->vec);
 }
 
+static void
+rcvr_dump(cxn_t *cxn)
+{
+    rcvr_t *r = (rcvr_t *) cxn;
+
+    hlog_fast(stall,
+              "%s: rcvr %p %zu RDMA targets posted, %" PRIu64
+              " bytes filled unread",
+              __func__, (void *) r, fifo_nfull(r->tgtposted), r->nfull);
+    hlog_fast(stall,
+              "%s: rcvr %p vectors %zu ready, %zu posted, %zu buffers free; "
+              "%zu progress receives posted",
+              __func__, (void *) r, fifo_nfull(r->vec.ready),
+              fifo_nfull(r->vec.posted), r->vec.pool->nfull,
+              fifo_nfull(r->progress.posted));
+}
+
 static loop_control_t
 rcvr_loop(worker_t *w, session_t *s)
 {
@@ -1979,17 +4031,30 @@ rcvr_loop(worker_t *w, session_t *s)
     if (!r->cxn.started)
         return rcvr_start(w, r, s->ready_for_cxn);
 
+    uint64_t t = stage_begin();
+
     if (rcvr_cq_process(r) == -1)
         return loop_error;
 
+    t = stage_end(&r->cxn, sg_cq, t);
+
     rcvr_vector_update(s->ready_for_cxn, r);
 
+    t = stage_end(&r->cxn, sg_vector_update, t);
+
     txctl_transmit(&r->cxn, &r->vec);
 
+    t = stage_end(&r->cxn, sg_txctl_transmit, t);
+
     rcvr_targets_read(s->ready_for_terminal, r);
 
-    if (fifo_eoget(s->ready_for_terminal) && r->cxn.eof.remote &&
-        r->cxn.eof.local && txctl_idle(&r->vec))
+    (void) stage_end(&r->cxn, sg_targets_read, t);
+
+    /* A terminal that holds buffers off of `ready_for_terminal` is not
+     * through with them, yet.
+     */
+    if (fifo_eoget(s->ready_for_terminal) && s->terminal->nheld == 0 &&
+        r->cxn.eof.remote && r->cxn.eof.local && txctl_idle(&r->vec))
         return loop_end;
 
     return loop_continue;
@@ -2057,7 +4122,10 @@ xmtr_ack_rx_process(xmtr_t *x, completion_t *cmpl)
     hlog_fast(addr, "xmtr %p registered address %jx", (void *) x,
               (uintmax_t) x->cxn.peer_addr);
 
-    while (rxctl_ready(&x->vec)) {
+    if (global_state.multi_recv)
+        rxctl_multi_start(&x->cxn, &x->vec);
+
+    while (!global_state.multi_recv && rxctl_ready(&x->vec)) {
         vecbuf_t *vb = vecbuf_alloc();
 
         rc = buf_mr_reg(global_state.domain, x->cxn.ep, FI_RECV,
@@ -2066,7 +4134,7 @@ xmtr_ack_rx_process(xmtr_t *x, completion_t *cmpl)
         if (rc < 0)
             bailout_for_ofi_ret(rc, "buffer memory registration failed");
 
-        rxctl_post(&x->cxn, &x->vec, &vb->hdr);
+        rxctl_post(&x->cxn, &x->vec, &vb->hdr, rxctl_more(&x->vec));
     }
 
     x->rcvd_ack = true;
@@ -2268,7 +4336,7 @@ xmtr_vecbuf_unload(xmtr_t *x)
 
     if (i == vb->msg.niovs) {
         (void) fifo_get(x->vec.rcvd);
-        rxctl_post(&x->cxn, &x->vec, &vb->hdr);
+        rxctl_recycle(&x->cxn, &x->vec, &vb->hdr);
         x->next_riov = 0;
     } else
         x->next_riov = i;
@@ -2284,6 +4352,7 @@ static int
 xmtr_vector_rx_process(xmtr_t *x, bufhdr_t *h)
 {
     vecbuf_t *vb = (vecbuf_t *) h;
+    uint32_t ahead;
 
     if (h->xfc.cancelled) {
         buf_free(h);
@@ -2292,26 +4361,186 @@ xmtr_vector_rx_process(xmtr_t *x, bufhdr_t *h)
 
     if (!vecbuf_is_wellformed(vb)) {
         hlog_fast(err, "%s: rx'd malformed vector message", __func__);
-        rxctl_post(&x->cxn, &x->vec, h);
+        rxctl_recycle(&x->cxn, &x->vec, h);
         return 0;
     }
 
-    if (!fifo_put(x->vec.rcvd, h))
-        errx(EXIT_FAILURE, "%s: received vectors FIFO was full", __func__);
+    /* Targets are filled in the order the receiver posted them, so
+     * the vectors go to `rcvd` in sequence order.
+     */
+    ahead = vb->msg.seq - x->vecseq.next;
+
+    if (ahead >= arraycount(x->vecseq.early) ||
+        x->vecseq.early[vb->msg.seq % arraycount(x->vecseq.early)] != NULL) {
+        hlog_fast(err,
+                  "%s: vector sequence number %" PRIu32
+                  " is out of the window at %" PRIu32,
+                  __func__, vb->msg.seq, x->vecseq.next);
+        return -1;
+    }
+
+    x->vecseq.early[vb->msg.seq % arraycount(x->vecseq.early)] = h;
+
+    while ((h = x->vecseq.early[x->vecseq.next %
+                                arraycount(x->vecseq.early)]) != NULL) {
+        if (!fifo_put(x->vec.rcvd, h)) {
+            errx(EXIT_FAILURE, "%s: received vectors FIFO was full",
+                 __func__);
+        }
+        x->vecseq.early[x->vecseq.next % arraycount(x->vecseq.early)] = NULL;
+        x->vecseq.next++;
+    }
+
+    counter_add(&x->cxn.stats->nctlmsgs, 1);
 
     return 1;
 }
 
+static inline bool
+xmtr_wrsb_test(uint64_t bits, size_t idx)
+{
+    return (bits & ((uint64_t) 1 << idx)) != 0;
+}
+
+/* Return the position in `wrposted` of the unreleased entry `h`, or
+ * the number of entries if there is none.
+ */
+static size_t
+xmtr_wrposted_find(xmtr_t *x, const bufhdr_t *h)
+{
+    bufhdr_t *e;
+    size_t i;
+
+    for (i = 0; (e = fifo_alt_peek_at(x->wrposted, i)) != NULL; i++) {
+        if (e == h &&
+            !xmtr_wrsb_test(x->wrsb.released, fifo_alt_index(x->wrposted, i)))
+            break;
+    }
+    return i;
+}
+
+/* Return the payload buffer at position `i` of `wrposted` to the
+ * terminal if nothing holds it: its own write and every write of its
+ * fragments completed.  Leave it in place if `ready_for_terminal` is
+ * full.
+ */
+static void
+xmtr_wrposted_release(xmtr_t *x, size_t i, fifo_t *ready_for_terminal)
+{
+    const size_t idx = fifo_alt_index(x->wrposted, i);
+    bufhdr_t *h = fifo_alt_peek_at(x->wrposted, i);
+    int rc;
+
+    if (h == NULL || xmtr_wrsb_test(x->wrsb.released, idx) ||
+        !xmtr_wrsb_test(x->wrsb.done, idx) || h->xfc.nchildren != 0 ||
+        fifo_full(ready_for_terminal))
+        return;
+
+    if (global_state.reregister && (rc = buf_mr_dereg(h)) != 0)
+        warn_about_ofi_ret(rc, "fi_close");
+
+    (void) fifo_alt_put(ready_for_terminal, h);
+    x->wrsb.released |= (uint64_t) 1 << idx;
+}
+
+/* Record the completion of the RDMA write whose first entry is at
+ * position `i` of `wrposted`, and release what it no longer holds.
+ */
+static void
+xmtr_write_complete(xmtr_t *x, size_t i, fifo_t *ready_for_terminal)
+{
+    bufhdr_t *h;
+    bool last;
+
+    for (last = false; !last && (h = fifo_alt_peek_at(x->wrposted, i)) != NULL;
+         i++) {
+        const size_t idx = fifo_alt_index(x->wrposted, i);
+
+        last = (h->xfc.place & xfp_last) != 0;
+        h->xfc.owner = xfo_program;
+        x->wrsb.done |= (uint64_t) 1 << idx;
+
+        if (h->xfc.type == xft_fragment) {
+            fragment_t *f = (fragment_t *) h;
+            bufhdr_t *parent = f->parent;
+
+            assert(parent->xfc.nchildren > 0);
+            parent->xfc.nchildren--;
+
+            x->wrsb.nbytes[idx] = 0;
+            x->wrsb.released |= (uint64_t) 1 << idx;
+            (void) buflist_put(x->fragment.pool, h);
+
+            /* The parent's own write may have completed already. */
+            if (parent->xfc.nchildren == 0) {
+                xmtr_wrposted_release(x, xmtr_wrposted_find(x, parent),
+                                      ready_for_terminal);
+            }
+        } else {
+            x->wrsb.nbytes[idx] = h->nused;
+            xmtr_wrposted_release(x, i, ready_for_terminal);
+        }
+    }
+}
+
+/* With -l <n>, the signaled RDMA write at position `i` of `wrposted`
+ * completed.  Complete the unsignaled writes posted between it and the
+ * previous signaled write, too.
+ */
+static void
+xmtr_unsignaled_complete(xmtr_t *x, size_t i, fifo_t *ready_for_terminal)
+{
+    bufhdr_t *h;
+
+    while (i-- > 0) {
+        const size_t idx = fifo_alt_index(x->wrposted, i);
+
+        if (xmtr_wrsb_test(x->wrsb.done, idx))
+            break;
+        h = fifo_alt_peek_at(x->wrposted, i);
+        if ((h->xfc.place & xfp_first) == 0)
+            continue;
+        if (h->xfc.signaled)
+            break;
+        xmtr_write_complete(x, i, ready_for_terminal);
+    }
+}
+
+/* Remove the completed entries at the front of `wrposted` and count
+ * their bytes as progress.  Release any buffer that could not return to
+ * the terminal before.
+ */
+static void
+xmtr_wrposted_retire(xmtr_t *x, fifo_t *ready_for_terminal)
+{
+    size_t idx;
+
+    while (!fifo_alt_empty(x->wrposted) &&
+           xmtr_wrsb_test(x->wrsb.done,
+                          (idx = fifo_alt_index(x->wrposted, 0)))) {
+        xmtr_wrposted_release(x, 0, ready_for_terminal);
+
+        if (!xmtr_wrsb_test(x->wrsb.released, idx))
+            break; // ready_for_terminal is full
+
+        x->bytes_progress += x->wrsb.nbytes[idx];
+        cxn_bytes_add(&x->cxn, x->wrsb.nbytes[idx]);
+        x->wrsb.done &= ~((uint64_t) 1 << idx);
+        x->wrsb.released &= ~((uint64_t) 1 << idx);
+        (void) fifo_alt_get(x->wrposted);
+    }
+}
+
 /* Process completions.  Return 0 if no completions occurred, 1 if
  * any completion occurred, -1 on an irrecoverable error.
  */
 static int
-xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal, bool reregister)
+xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal)
 {
-    struct fi_cq_msg_entry fcmpl;
+    struct fi_cq_data_entry fcmpl;
     completion_t cmpl, *cmplp;
     bufhdr_t *h;
-    size_t nprocessed;
+    size_t i, nprocessed;
     ssize_t ncompleted;
 
     if ((ncompleted = fi_cq_read(x->cxn.cq, &fcmpl, 1)) == -FI_EAGAIN)
@@ -2346,9 +4575,14 @@ xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal, bool reregister)
              ncompleted);
     } else {
         cmpl = (completion_t){
-            .xfc = fcmpl.op_context, .flags = fcmpl.flags, .len = fcmpl.len};
+            .xfc = fcmpl.op_context,
+            .flags = fcmpl.flags,
+            .len = fcmpl.len,
+            .buf = global_state.multi_recv ? fcmpl.buf : NULL};
     }
 
+    x->cxn.ncompletions++;
+
     cmpl.xfc->owner = xfo_program;
 
     switch (cmpl.xfc->type) {
@@ -2356,7 +4590,8 @@ xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal, bool reregister)
             hlog_fast(completion, "%s: read a vector rx completion", __func__);
 
             for (nprocessed = 0, cmplp = &cmpl;
-                 (h = rxctl_complete(&x->vec, cmplp)) != NULL; cmplp = NULL) {
+                 (h = rxctl_complete(&x->cxn, &x->vec, cmplp)) != NULL;
+                 cmplp = NULL) {
                 switch (xmtr_vector_rx_process(x, h)) {
                     case 1:
                         nprocessed++;
@@ -2372,49 +4607,31 @@ xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal, bool reregister)
         case xft_rdma_write:
             hlog_fast(completion, "%s: read an RDMA-write completion",
                       __func__);
-            /* If the head of `wrposted` is marked `xfo_program`, then dequeue
-             * the txbuffers at the head of `wrposted` through the last one
-             * marked `xfo_program`.
+            /* Only signaled writes count as outstanding, but the
+             * cancellation of an unsignaled one completes, too.
              */
-            if ((h = fifo_peek(x->wrposted)) == NULL) {
-                hlog_fast(err, "%s: no RDMA-write completions expected",
-                          __func__);
-                return -1;
-            }
-            /* XXX This can fail if `ready_for_terminal` ever fills
-             * to capacity, in the loop below.  That should not happen
-             * unless we accidentally put more buffers into circulation
-             * than there are slots in `ready_for_terminal`.
+            if (cmpl.xfc->signaled && x->signal.noutstanding > 0)
+                x->signal.noutstanding--;
+            /* Writes may complete in any order.  Record this one on the
+             * scoreboard, then retire the completed writes at the front
+             * of `wrposted`.
              */
-            if ((h->xfc.place & xfp_first) == 0) {
-                hlog_fast(err, "%s: expected `first` context at head",
-                          __func__);
+            h = (bufhdr_t *) ((char *) cmpl.xfc - offsetof(bufhdr_t, xfc));
+            if ((i = xmtr_wrposted_find(x, h)) == fifo_nfull(x->wrposted) ||
+                (h->xfc.place & xfp_first) == 0) {
+                hlog_fast(err, "%s: no RDMA-write completion expected for %p",
+                          __func__, (void *) cmpl.xfc);
                 return -1;
             }
-            while ((h = fifo_peek(x->wrposted)) != NULL &&
-                   h->xfc.owner == xfo_program && h->xfc.type == xft_fragment) {
-                fragment_t *f = (fragment_t *) h;
-                (void) fifo_get(x->wrposted);
-
-                assert(f->parent->xfc.nchildren > 0);
-                f->parent->xfc.nchildren--;
-
-                (void) buflist_put(x->fragment.pool, h);
-            }
-            while ((h = fifo_peek(x->wrposted)) != NULL &&
-                   h->xfc.owner == xfo_program &&
-                   h->xfc.type == xft_rdma_write && h->xfc.nchildren == 0 &&
-                   !fifo_full(ready_for_terminal)) {
-                int rc;
-
-                (void) fifo_get(x->wrposted);
-
-                if (reregister && (rc = buf_mr_dereg(h)) != 0)
-                    warn_about_ofi_ret(rc, "fi_close");
-
-                x->bytes_progress += h->nused;
-                (void) fifo_alt_put(ready_for_terminal, h);
-            }
+            if (global_state.signal_interval > 1)
+                xmtr_unsignaled_complete(x, i, ready_for_terminal);
+            xmtr_write_complete(x, i, ready_for_terminal);
+            /* XXX Retirement stalls if `ready_for_terminal` ever fills
+             * to capacity.  That should not happen unless we
+             * accidentally put more buffers into circulation than there
+             * are slots in `ready_for_terminal`.
+             */
+            xmtr_wrposted_retire(x, ready_for_terminal);
             return 1;
         case xft_progress:
             hlog_fast(completion, "%s: read a progress tx completion",
@@ -2433,6 +4650,22 @@ xmtr_cq_process(xmtr_t *x, fifo_t *ready_for_terminal, bool reregister)
     }
 }
 
+/* Return the length of the first RDMA target in `riov[0 .. nriovs - 1]`
+ * that has bytes left after `len` bytes are written, or 0 if none does.
+ */
+static size_t
+riov_next_len(const struct fi_rma_iov *riov, size_t nriovs, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < nriovs; i++) {
+        if (len < riov[i].len)
+            return riov[i].len - len;
+        len -= riov[i].len;
+    }
+    return 0;
+}
+
 static bufhdr_t *
 xmtr_buf_split(xmtr_t *x, bufhdr_t *parent, size_t len)
 {
@@ -2472,16 +4705,22 @@ xmtr_buf_split(xmtr_t *x, bufhdr_t *parent, size_t len)
  * of the Tx buffers.  Set the owner of the first to `xfo_nic`.
  *
  * Finally, perform one fi_writemsg using the context on the first
- * Tx buffer.
+ * Tx buffer.  Set `*more` to true if the write carries FI_MORE, in
+ * which case the caller must write again.
  */
 static loop_control_t
-xmtr_targets_write(fifo_t *ready_for_cxn, xmtr_t *x)
+xmtr_target_write(fifo_t *ready_for_cxn, xmtr_t *x, bool *more)
 {
     bufhdr_t *first_h, *h, *head, *last_h = NULL;
     const size_t maxriovs = minsize(global_state.rma_maxsegs, x->nriovs);
     size_t i, len, maxbytes, niovs, niovs_out = 0, nriovs_out = 0, total;
     ssize_t nwritten, rc;
 
+    *more = false;
+
+    if (!cxn_may_issue(&x->cxn))
+        return loop_continue;
+
     for (maxbytes = 0, i = 0; i < maxriovs; i++)
         maxbytes += ((!x->phase) ? x->riov : x->riov2)[i].len;
 
@@ -2555,6 +4794,43 @@ xmtr_targets_write(fifo_t *ready_for_cxn, xmtr_t *x)
         first_h->xfc.place = xfp_first;
         last_h->xfc.place |= xfp_last;
 
+        /* Another write is sure to follow this one if the next Tx
+         * buffer fits in the first RDMA target left over after this
+         * write, so that it is neither fragmented nor held back for more
+         * RDMA vectors.  With batching, chain that write after this one.
+         */
+        bool next_sure = false;
+
+        if ((head = fifo_peek(ready_for_cxn)) != NULL &&
+            !fifo_full(x->wrposted)) {
+            const size_t nextlen = riov_next_len(
+                (!x->phase) ? x->riov : x->riov2, x->nriovs, total);
+
+            next_sure =
+                0 < nextlen && head->nused - x->fragment.offset <= nextlen;
+        }
+        next_sure = next_sure && cxn_may_issue_another(&x->cxn);
+        *more = global_state.batch && next_sure;
+
+        /* With -l <n>, request a completion on every nth write, and on
+         * any write that may be the last for a while, so that the
+         * writes before it retire.  The provider completes writes in
+         * order (FI_ORDER_STRICT, checked at startup), so the completion
+         * of a signaled write implies the completion of the unsignaled
+         * writes before it.
+         */
+        const bool signaled =
+            !next_sure ||
+            x->signal.nunsignaled + 1 >= global_state.signal_interval;
+
+        first_h->xfc.signaled = signaled;
+        if (signaled) {
+            x->signal.nunsignaled = 0;
+            x->signal.noutstanding++;
+        } else {
+            x->signal.nunsignaled++;
+        }
+
         write_fully_params_t p = {
             .ep = x->cxn.ep,
             .iov_in = (!x->phase) ? x->payload.iov : x->payload.iov2,
@@ -2569,7 +4845,10 @@ xmtr_targets_write(fifo_t *ready_for_cxn, xmtr_t *x)
             .nriovs_out = &nriovs_out,
             .len = total,
             .maxsegs = maxriovs,
-            .flags = FI_COMPLETION | FI_DELIVERY_COMPLETE,
+            .flags = (signaled ? FI_COMPLETION : 0) |
+                     (global_state.transmit_complete ? FI_TRANSMIT_COMPLETE
+                                                     : FI_DELIVERY_COMPLETE) |
+                     (*more ? FI_MORE : 0),
             .context = &first_h->xfc.ctx,
             .addr = x->cxn.peer_addr};
 
@@ -2589,7 +4868,38 @@ xmtr_targets_write(fifo_t *ready_for_cxn, xmtr_t *x)
         x->nriovs = nriovs_out;
 
         x->phase = !x->phase;
+
+        counter_add(&x->cxn.stats->nwrites, 1);
+        cxn_issued(&x->cxn);
+    }
+    return loop_continue;
+}
+
+/* Write Tx buffers to RDMA targets.  Without batching, perform at most
+ * one write.  With batching, chain writes for as long as
+ * `xmtr_target_write` sets FI_MORE on them.  With -q, keep writing
+ * until the session's deficit runs out or a write is not possible.
+ */
+static loop_control_t
+xmtr_targets_write(fifo_t *ready_for_cxn, xmtr_t *x)
+{
+    bool more;
+
+    for (;;) {
+        const unsigned deficit = x->cxn.drr.deficit;
+
+        if (xmtr_target_write(ready_for_cxn, x, &more) == loop_error)
+            return loop_error;
+        if (more)
+            continue;
+        /* Without -q the deficit never changes, so this ends the loop.
+         * With -q, stop when a write was not possible or the deficit
+         * is spent.
+         */
+        if (x->cxn.drr.deficit == deficit || !cxn_may_issue(&x->cxn))
+            break;
     }
+
     return loop_continue;
 }
 
@@ -2632,6 +4942,7 @@ xmtr_progress_update(fifo_t *ready_for_cxn, xmtr_t *x)
 
     pb->msg.nfilled = progress;
     pb->msg.nleftover = reached_eof ? 0 : 1;
+    pb->msg.seq = x->progress.nextseq++;
 
     hlog_fast(proto_progress,
               "%s: sending progress message, %" PRIu64 " filled, %" PRIu64
@@ -2651,6 +4962,26 @@ xmtr_progress_update(fifo_t *ready_for_cxn, xmtr_t *x)
         xmtr_progress_update(ready_for_cxn, x);
 }
 
+/* Cancel the RDMA writes on `wrposted` that did not complete.  Unlike
+ * `fifo_cancel`, skip the stale entries that the scoreboard released.
+ */
+static void
+xmtr_wrposted_cancel(xmtr_t *x)
+{
+    bufhdr_t *h;
+    size_t i, idx;
+    int rc;
+
+    for (i = 0; (h = fifo_alt_peek_at(x->wrposted, i)) != NULL; i++) {
+        idx = fifo_alt_index(x->wrposted, i);
+        if (xmtr_wrsb_test(x->wrsb.done | x->wrsb.released, idx))
+            continue;
+        h->xfc.cancelled = 1;
+        if ((rc = fi_cancel(&x->cxn.ep->fid, &h->xfc.ctx)) != 0)
+            bailout_for_ofi_ret(rc, "fi_cancel");
+    }
+}
+
 static void
 xmtr_cancel(cxn_t *cxn)
 {
@@ -2658,7 +4989,7 @@ xmtr_cancel(cxn_t *cxn)
 
     txctl_cancel(x->cxn.ep, &x->progress);
     rxctl_cancel(x->cxn.ep, &x->vec);
-    fifo_cancel(x->cxn.ep, x->wrposted);
+    xmtr_wrposted_cancel(x);
 }
 
 static bool
@@ -2666,8 +4997,30 @@ xmtr_cancellation_complete(cxn_t *cxn)
 {
     xmtr_t *x = (xmtr_t *) cxn;
 
+    /* With -l <n>, the unsignaled writes that no signaled write
+     * follows will never complete.  Do not wait for them.
+     */
     return txctl_idle(&x->progress) && rxctl_idle(&x->vec) &&
-           fifo_empty(x->wrposted);
+           (fifo_empty(x->wrposted) || (global_state.signal_interval > 1 &&
+                                        x->signal.noutstanding == 0));
+}
+
+static void
+xmtr_dump(cxn_t *cxn)
+{
+    xmtr_t *x = (xmtr_t *) cxn;
+
+    hlog_fast(stall,
+              "%s: xmtr %p %zu RDMA writes posted, %zu RDMA targets held, "
+              "%zu bytes progress unsent, ack %sreceived",
+              __func__, (void *) x, fifo_nfull(x->wrposted), x->nriovs,
+              x->bytes_progress, x->rcvd_ack ? "" : "not ");
+    hlog_fast(stall,
+              "%s: xmtr %p vectors %zu posted, %zu received; progress %zu "
+              "ready, %zu posted, %zu buffers free",
+              __func__, (void *) x, fifo_nfull(x->vec.posted),
+              fifo_nfull(x->vec.rcvd), fifo_nfull(x->progress.ready),
+              fifo_nfull(x->progress.posted), x->progress.pool->nfull);
 }
 
 static loop_control_t
@@ -2675,11 +5028,13 @@ xmtr_loop(worker_t *w, session_t *s)
 {
     vecbuf_t *vb;
     xmtr_t *x = (xmtr_t *) s->cxn;
+    uint64_t t = stage_begin();
 
-    if (xmtr_cq_process(x, s->ready_for_terminal, global_state.reregister) ==
-        -1)
+    if (xmtr_cq_process(x, s->ready_for_terminal) == -1)
         return loop_error;
 
+    t = stage_end(&x->cxn, sg_cq, t);
+
     if (!x->cxn.sent_first)
         return xmtr_initial_send(x);
 
@@ -2689,16 +5044,26 @@ xmtr_loop(worker_t *w, session_t *s)
     if (!x->rcvd_ack)
         return loop_continue;
 
+    t = stage_begin();
+
     while (xmtr_vecbuf_unload(x))
         ; // do nothing
 
+    t = stage_end(&x->cxn, sg_vecbuf_unload, t);
+
     if (xmtr_targets_write(s->ready_for_cxn, x) == loop_error)
         return loop_error;
 
+    t = stage_end(&x->cxn, sg_targets_write, t);
+
     xmtr_progress_update(s->ready_for_cxn, x);
 
+    t = stage_end(&x->cxn, sg_progress_update, t);
+
     txctl_transmit(&x->cxn, &x->progress);
 
+    (void) stage_end(&x->cxn, sg_txctl_transmit, t);
+
     if (!(fifo_eoget(s->ready_for_cxn) && fifo_empty(x->wrposted) &&
           x->bytes_progress == 0 && x->cxn.eof.local))
         return loop_continue;
@@ -2718,20 +5083,30 @@ xmtr_loop(worker_t *w, session_t *s)
     return loop_continue;
 }
 
-static void
+/* Release session `s`.  Return false if its terminal's I/O failed
+ * at the last, as when a sink file could not be synced.
+ */
+static bool
 session_shutdown(session_t *s)
 {
     bufhdr_t *h;
     cxn_t *cxn = s->cxn;
+    bool ok = true;
     int rc;
 
     if (cxn->shutdown != NULL)
         cxn->shutdown(cxn);
 
+    if (s->terminal->shutdown != NULL)
+        ok = s->terminal->shutdown(s->terminal);
+
     assert(cxn->parent == s);
     cxn->parent = NULL;
     s->cxn = NULL;
 
+    atomic_store_explicit(&cxn->stats->state, FABTSTATS_SESSION_CLOSED,
+                          memory_order_relaxed);
+
     while ((h = fifo_alt_get(s->ready_for_cxn)) != NULL ||
            (h = fifo_alt_get(s->ready_for_terminal)) != NULL) {
         buf_mr_dereg(h);
@@ -2746,6 +5121,42 @@ session_shutdown(session_t *s)
         hlog_fast(leak, "%s: could not fi_close endpoint %p: %s", __func__,
                   (void *) &cxn->ep, fi_strerror(-rc));
     }
+    return ok;
+}
+
+/* Report on a session that the watchdog flagged for moving no bytes,
+ * and cancel it if the user asked for that.
+ */
+static void
+session_stalled(session_t *s)
+{
+    cxn_t *cxn = s->cxn;
+
+    atomic_store_explicit(&cxn->stalled, false, memory_order_relaxed);
+
+    hlog_fast(stall,
+              "%s: session %p stalled at %" PRIu64 " bytes: "
+              "ready_for_cxn %zu full%s, ready_for_terminal %zu full%s",
+              __func__, (void *) s,
+              atomic_load_explicit(&cxn->stats->nbytes, memory_order_relaxed),
+              fifo_nfull(s->ready_for_cxn),
+              fifo_eoget(s->ready_for_cxn) ? " (closed)" : "",
+              fifo_nfull(s->ready_for_terminal),
+              fifo_eoget(s->ready_for_terminal) ? " (closed)" : "");
+    hlog_fast(stall,
+              "%s: session %p eof local %d remote %d, sent first %d, "
+              "started %d, cancelled %d, ended %d",
+              __func__, (void *) s, cxn->eof.local, cxn->eof.remote,
+              cxn->sent_first, cxn->started, cxn->cancelled, cxn->ended);
+
+    cxn->dump(cxn);
+
+    if (!global_state.stall.cancel || cxn->cancelled || cxn->ended)
+        return;
+
+    hlog_fast(stall, "%s: cancelling session %p", __func__, (void *) s);
+    cxn->cancel(cxn);
+    cxn->cancelled = true;
 }
 
 static loop_control_t
@@ -2763,6 +5174,10 @@ cxn_loop(worker_t *w, session_t *s)
             hlog_fast(close, "%s: shutting down.", __func__);
             break;
         case loop_continue:
+            if (atomic_load_explicit(&cxn->stalled,
+                                     memory_order_relaxed))
+                session_stalled(s);
+
             if (cxn->cancelled || cxn->ended) {
                 if (cxn->cancellation_complete(cxn)) {
                     hlog_fast(close, "%s: closed.", __func__);
@@ -2786,32 +5201,46 @@ session_loop(worker_t *w, session_t *s)
 
     hlog_fast(session_loop, "%s: going around", __func__);
 
+    const uint64_t begin = stage_begin();
+
     if (t->trade(t, s->ready_for_terminal, s->ready_for_cxn) == loop_error)
         return loop_error;
 
-    return cxn_loop(w, s);
+    (void) stage_end(s->cxn, sg_trade, begin);
+
+    const loop_control_t ctl = cxn_loop(w, s);
+    cxn_stats_t *stats = s->cxn->stats;
+
+    atomic_store_explicit(&stats->cxn_fifo, fifo_nfull(s->ready_for_cxn),
+                          memory_order_relaxed);
+    atomic_store_explicit(&stats->terminal_fifo,
+                          fifo_nfull(s->ready_for_terminal),
+                          memory_order_relaxed);
+
+    return ctl;
 }
 
-static void
-sessions_swap(session_t *r, session_t *s)
+static inline unsigned
+session_slot_bit(const session_t *session_half, const session_t *s)
 {
-    session_t tmp;
-
-    if (r == s)
-        return;
+    return 1U << (s - session_half);
+}
 
-    tmp = *r;
-    *r = *s;
-    if (r->cxn != NULL)
-        r->cxn->parent = r;
-    *s = tmp;
-    if (s->cxn != NULL)
-        s->cxn->parent = s;
+/* Return true if session `s` needs service whether or not its CQ
+ * has completions ready.
+ */
+static bool
+session_is_pending(const session_t *s)
+{
+    return !s->cxn->sent_first || !fifo_empty(s->ready_for_terminal) ||
+           s->terminal->nheld != 0;
 }
 
 static void
-worker_update_load(load_t *load, int nready)
+worker_update_load(worker_t *self, int nready)
 {
+    load_t *load = &self->load;
+
     if (nready > load->max_loop_contexts)
         load->max_loop_contexts = nready;
 
@@ -2827,6 +5256,8 @@ worker_update_load(load_t *load, int nready)
         load->average = (load->average + 256 * load->ctxs_serviced_since_mark /
                                              (UINT16_MAX + 1)) /
                         2;
+        atomic_store_explicit(&self->stats->load_average, load->average,
+                              memory_order_relaxed);
         hlog_fast(average, "%s: average %" PRIuFAST16 "x%" PRIuFAST16, __func__,
                   load->average / (uint_fast16_t) 256,
                   load->average % (uint_fast16_t) 256);
@@ -2850,7 +5281,7 @@ worker_waitable(worker_t *self)
     size_t i;
     bool waitable;
 
-    self->stats.epoll_loops.total++;
+    counter_add(&self->stats->epoll_loops.total, 1);
 
     if (global_state.cancelled)
         return false;
@@ -2858,6 +5289,10 @@ worker_waitable(worker_t *self)
     if (self->nsessions[0] == 0 && self->nsessions[1] == 0)
         return false;
 
+    if (atomic_load_explicit(&self->inbox.tail, memory_order_relaxed) !=
+        self->inbox.head)
+        return false;
+
     for (i = 0; i < arraycount(self->session); i++) {
         session_t *s = &self->session[i];
         cxn_t *c = s->cxn;
@@ -2865,7 +5300,8 @@ worker_waitable(worker_t *self)
         if (c == NULL)
             continue;
 
-        if (!s->waitable)
+        if (!s->waitable ||
+            atomic_load_explicit(&c->stalled, memory_order_relaxed))
             return false;
 
         fid[nfids++] = &c->cq->fid;
@@ -2873,7 +5309,7 @@ worker_waitable(worker_t *self)
 
     waitable = (fi_trywait(global_state.fabric, fid, nfids) == FI_SUCCESS);
     if (waitable)
-        self->stats.epoll_loops.waitable++;
+        counter_add(&self->stats->epoll_loops.waitable, 1);
     return waitable;
 }
 
@@ -2912,6 +5348,120 @@ extract_contexts_for_half(const session_t *session_half,
     return ncontexts;
 }
 
+/* Hand session `s` to worker `w` through its inbox.  Return false if
+ * `w` has no room for another session.  Caller must hold `workers_mtx`.
+ */
+static bool
+worker_assign_session(worker_t *w, session_t s)
+{
+    size_t n = atomic_load_explicit(&w->nassigned, memory_order_relaxed);
+    size_t idx;
+    int rc;
+
+    do {
+        if (n == arraycount(w->session))
+            return false;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &w->nassigned, &n, n + 1, memory_order_acquire, memory_order_relaxed));
+
+    idx = atomic_fetch_add_explicit(&w->inbox.tail, 1, memory_order_relaxed) %
+          arraycount(w->inbox.session);
+
+    assert(!atomic_load_explicit(&w->inbox.full[idx], memory_order_acquire));
+    w->inbox.session[idx] = s;
+    atomic_store_explicit(&w->inbox.full[idx], true, memory_order_release);
+
+    /* Interrupt the worker if it sleeps in epoll_pwait(2). */
+    if (global_state.waitfd && (rc = pthread_kill(w->thd, SIGUSR1)) != 0) {
+        errx(EXIT_FAILURE, "%s: could not signal thread for worker %p: %s",
+             __func__, (void *) w, strerror(rc));
+    }
+    return true;
+}
+
+/* Stop watching the CQ of `c`, a session in half `half` of session[]. */
+static void
+worker_cq_forget(worker_t *self, size_t half, cxn_t *c)
+{
+    int rc;
+
+    if (self->pollable &&
+        (rc = fi_poll_del(self->pollset[half], &c->cq->fid, 0)) != 0)
+        bailout_for_ofi_ret(rc, "fi_poll_del");
+    else {
+        hlog_fast(poll, "%s: removed CQ %p from worker %p poll set", __func__,
+                  (void *) &c->cq, (void *) self);
+    }
+
+    if (!global_state.waitfd)
+        ;
+    else if (epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, c->cq_wait_fd, NULL) ==
+             -1) {
+        err(EXIT_FAILURE, "%s.%d: epoll_ctl(,EPOLL_CTL_DEL,)", __func__,
+            __LINE__);
+    }
+}
+
+/* Move the sessions that other threads handed off from the inbox to
+ * free slots of session[].
+ */
+static void
+worker_inbox_drain(worker_t *self)
+{
+    const size_t nslots = arraycount(self->session) / 2;
+    size_t half, i, idx;
+    int rc;
+
+    for (;;) {
+        idx = self->inbox.head % arraycount(self->inbox.session);
+
+        if (!atomic_load_explicit(&self->inbox.full[idx],
+                                  memory_order_acquire))
+            return;
+
+        for (half = 0; half < 2; half++) {
+            if (self->slots[half].occupied != (1U << nslots) - 1)
+                break;
+        }
+        assert(half < 2);
+
+        for (i = 0; (self->slots[half].occupied & (1U << i)) != 0; i++)
+            ; // do nothing
+
+        session_t *slot = &self->session[half * nslots + i];
+
+        *slot = self->inbox.session[idx];
+        slot->cxn->parent = slot;
+        self->slots[half].occupied |= 1U << i;
+        self->slots[half].pending |= 1U << i;
+
+        atomic_store_explicit(&self->inbox.full[idx], false,
+                              memory_order_relaxed);
+        self->inbox.head++;
+
+        rc = self->pollable
+                 ? fi_poll_add(self->pollset[half], &slot->cxn->cq->fid, 0)
+                 : 0;
+
+        if (rc != 0)
+            bailout_for_ofi_ret(rc, "fi_poll_add");
+
+        if (!global_state.waitfd)
+            ;
+        else if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD,
+                           slot->cxn->cq_wait_fd,
+                           &(struct epoll_event){
+                               .events = EPOLLIN,
+                               .data = {.ptr = slot->cxn}}) == -1) {
+            err(EXIT_FAILURE, "%s.%d: epoll_ctl(,EPOLL_CTL_ADD,)", __func__,
+                __LINE__);
+        }
+
+        atomic_fetch_add_explicit(&self->nsessions[half], 1,
+                                  memory_order_relaxed);
+    }
+}
+
 static void
 worker_run_loop(worker_t *self)
 {
@@ -2928,14 +5478,12 @@ worker_run_loop(worker_t *self)
         errno != EINTR)
         err(EXIT_FAILURE, "%s: epoll_pwait", __func__);
 
+    worker_inbox_drain(self);
+
     for (half = 0; half < 2; half++) {
         void *context[WORKER_SESSIONS_MAX];
-        pthread_mutex_t *mtx = &self->mtx[half];
         session_t *session_half = &self->session[half * nsessions / 2];
-        int ncontexts, rc;
-
-        if (pthread_mutex_trylock(mtx) == EBUSY)
-            continue;
+        int ncontexts;
 
         if (global_state.waitfd) {
             ncontexts = extract_contexts_for_half(session_half, events, nevents,
@@ -2943,10 +5491,8 @@ worker_run_loop(worker_t *self)
         } else if (self->pollable) {
             ncontexts =
                 fi_poll(self->pollset[half], context, WORKER_SESSIONS_MAX);
-            if (ncontexts < 0) {
-                (void) pthread_mutex_unlock(mtx);
+            if (ncontexts < 0)
                 bailout_for_ofi_ret(ncontexts, "fi_poll");
-            }
         } else {
             ncontexts = extract_contexts_for_half(session_half, NULL, 0,
                                                   context, false);
@@ -2958,7 +5504,9 @@ worker_run_loop(worker_t *self)
          * May need to take care about counting all sessions ready because
          * they are cancelled.
          */
-        worker_update_load(&self->load, ncontexts);
+        worker_update_load(self, ncontexts);
+
+        unsigned io_ready = 0, ready;
 
         for (i = 0; i < ncontexts; i++) {
             cxn_t *c = context[i];
@@ -2970,87 +5518,43 @@ worker_run_loop(worker_t *self)
 
             assert(0 <= s - session_half && s - session_half < nsessions / 2);
 
-            sessions_swap(s, &session_half[i]);
+            io_ready |= session_slot_bit(session_half, s);
         }
 
-        session_t *io_ready_up_to = &session_half[ncontexts];
-        session_t *ready_up_to = io_ready_up_to;
-
-        for (i = ready_up_to - session_half; i < nsessions / 2; i++) {
-            session_t *s = &session_half[i];
-            cxn_t *c = s->cxn;
+        ready = io_ready | self->slots[half].pending;
 
-            // skip empty slots
-            if (c == NULL)
-                continue;
+        /* Cancellation and the watchdog reach sessions from other
+         * threads, so look for them here.
+         */
+        for (i = 0; i < nsessions / 2; i++) {
+            const unsigned bit = 1U << i;
+            cxn_t *c = session_half[i].cxn;
 
-            if (c->sent_first && fifo_empty(s->ready_for_terminal) &&
-                !global_state.cancelled)
+            if ((self->slots[half].occupied & ~ready & bit) == 0)
                 continue;
 
-            sessions_swap(s, ready_up_to);
-            ready_up_to++;
+            if (global_state.cancelled ||
+                atomic_load_explicit(&c->stalled, memory_order_relaxed))
+                ready |= bit;
         }
 
-        session_t *active_up_to = ready_up_to;
-
-        self->stats.half_loops.total++;
-
-        if (io_ready_up_to == session_half)
-            self->stats.half_loops.no_io_ready++;
-
-        if (ready_up_to == io_ready_up_to)
-            self->stats.half_loops.no_session_ready++;
-
-        /*
-         * TBD change terminology to `occupied` and `empty` slots.
-         */
-
-        /* Move active session slots (i.e., s->cxn != NULL) to front
-         * so that inactive slots are consecutive at the end of
-         * the self->session[] half.  Point `active_up_to` at
-         * the first inactive slot or, if there are no inactive
-         * slots, point it one past the end of the session[] half.
-         */
-        for (i = active_up_to - session_half; i < nsessions / 2; i++) {
-            session_t *s = &session_half[i];
-
-            // skip empty (inactive) slots
-            if (s->cxn == NULL)
-                continue;
+        counter_add(&self->stats->half_loops.total, 1);
 
-            sessions_swap(s, active_up_to);
-            active_up_to++;
-        }
+        if (io_ready == 0)
+            counter_add(&self->stats->half_loops.no_io_ready, 1);
 
-#if 1
-        session_t *ready_from = session_half;
-#else
-        session_t *ready_from;
-        bool stole;
+        if ((ready & ~io_ready) == 0)
+            counter_add(&self->stats->half_loops.no_session_ready, 1);
 
-        /* TBD If
-         * `ready_up_to == session_half`,
-         * then choose a second worker at random and ask for it to
-         * fill inactive session slots, if there are any.
-         */
+        if (ready == 0)
+            self->cpu.nidle_half_loops++;
 
-        if (ready_up_to == session_half &&
-            active_up_to - session_half < arraycount(self->session) / 2) {
-            worker_steal(self, active_up_to,
-                         arraycount(self->session) / 2 -
-                             (active_up_to - session_half),
-                         &ready_up_to);
-            stole = true;
-        } else {
-            ready_from = session_half;
-            stole = false;
-        }
-#endif
+        const uint64_t service_start =
+            (global_state.pool.adaptive && ready != 0) ? stage_clock() : 0;
 
         /* Service ready session slots. */
-        for (i = ready_from - session_half; i < ready_up_to - session_half;
-             i++) {
+        for (i = 0; i < nsessions / 2; i++) {
+            const unsigned bit = 1U << i;
             session_t *s;
             cxn_t *c;
             struct {
@@ -3059,22 +5563,27 @@ worker_run_loop(worker_t *self)
                 eof_state_t eof;
             } after;
 
-            s = &session_half[i];
-
-            if (s == ready_up_to) {
-                assert(i >= ncontexts);
-                break;
-            }
+            if ((ready & bit) == 0)
+                continue;
 
+            s = &session_half[i];
             c = s->cxn;
             assert(c != NULL);
 
-            assert(/* stole || */ i < ncontexts || !c->sent_first ||
-                   !fifo_empty(s->ready_for_terminal) ||
-                   global_state.cancelled);
+            if (global_state.weights.n != 0)
+                c->drr.deficit += c->drr.weight;
 
             loop_control_t ctl = session_loop(self, s);
 
+            /* A session that spent its whole deficit may have more to
+             * do.  Service it on the next pass, I/O or not.
+             */
+            const bool throttled =
+                global_state.weights.n != 0 && c->drr.deficit == 0;
+
+            if (global_state.weights.n != 0)
+                cxn_deficit_settle(c, !fifo_empty(s->ready_for_cxn));
+
             after.cxn_empty = fifo_empty(s->ready_for_cxn);
             after.terminal_full = fifo_full(s->ready_for_terminal);
             after.eof = c->eof;
@@ -3085,9 +5594,16 @@ worker_run_loop(worker_t *self)
                 s->waitable = false;
             else if (!c->sent_first)
                 s->waitable = false;
+            else if (throttled)
+                s->waitable = false;
             else
                 s->waitable = true;
 
+            if (throttled || session_is_pending(s))
+                self->slots[half].pending |= bit;
+            else
+                self->slots[half].pending &= ~bit;
+
             // continue at next cxn_t if `c` did not exit
             switch (ctl) {
                 case loop_continue:
@@ -3102,29 +5618,30 @@ worker_run_loop(worker_t *self)
                     break;
             }
 
-            if (self->pollable &&
-                (rc = fi_poll_del(self->pollset[half], &c->cq->fid, 0)) != 0)
-                bailout_for_ofi_ret(rc, "fi_poll_del");
-            else {
-                hlog_fast(poll, "%s: removed CQ %p from worker %p poll set",
-                          __func__, (void *) &c->cq, (void *) self);
-            }
+            worker_cq_forget(self, half, c);
 
-            if (!global_state.waitfd)
-                ;
-            else if (epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, c->cq_wait_fd,
-                               NULL) == -1) {
-                err(EXIT_FAILURE, "%s.%d: epoll_ctl(,EPOLL_CTL_DEL,)", __func__,
-                    __LINE__);
+            self->totals.nbytes +=
+                atomic_load_explicit(&c->stats->nbytes, memory_order_relaxed);
+            self->totals.ncompletions += c->ncompletions;
+            if (global_state.stages) {
+                stage_times_log("session", (void *) s, &c->stages);
+                stage_times_add(&self->totals.stages, &c->stages);
             }
 
-            session_shutdown(s);
+            if (!session_shutdown(s))
+                self->failed = true;
+
+            self->slots[half].occupied &= ~bit;
+            self->slots[half].pending &= ~bit;
 
             atomic_fetch_add_explicit(&self->nsessions[half], -1,
                                       memory_order_relaxed);
+            atomic_fetch_sub_explicit(&self->nassigned, 1,
+                                      memory_order_release);
         }
 
-        (void) pthread_mutex_unlock(mtx);
+        if (service_start != 0)
+            self->load.busy_ticks += stage_clock() - service_start;
     }
 }
 
@@ -3132,9 +5649,8 @@ static bool
 worker_is_idle(worker_t *self)
 {
     const ptrdiff_t self_idx = self - &workers[0];
-    size_t half, nlocked;
 
-    if (self->nsessions[0] != 0 || self->nsessions[1] != 0)
+    if (atomic_load_explicit(&self->nassigned, memory_order_relaxed) != 0)
         return false;
 
     if (self_idx + (size_t) 1 !=
@@ -3144,13 +5660,9 @@ worker_is_idle(worker_t *self)
     if (pthread_mutex_trylock(&workers_mtx) == EBUSY)
         return false;
 
-    for (nlocked = 0; nlocked < 2; nlocked++) {
-        if (pthread_mutex_trylock(&self->mtx[nlocked]) == EBUSY)
-            break;
-    }
-
+    /* Threads hand off sessions only while they hold `workers_mtx`. */
     bool idle =
-        (nlocked == 2 && self->nsessions[0] == 0 && self->nsessions[1] == 0 &&
+        (atomic_load_explicit(&self->nassigned, memory_order_acquire) == 0 &&
          self_idx + (size_t) 1 == nworkers_running);
 
     if (idle) {
@@ -3158,14 +5670,143 @@ worker_is_idle(worker_t *self)
         pthread_cond_signal(&nworkers_cond);
     }
 
-    for (half = 0; half < nlocked; half++)
-        (void) pthread_mutex_unlock(&self->mtx[half]);
-
     (void) pthread_mutex_unlock(&workers_mtx);
 
     return idle;
 }
 
+static inline uint_fast16_t
+worker_utilization(worker_t *w)
+{
+    return atomic_load_explicit(&w->load.utilization, memory_order_relaxed);
+}
+
+static inline size_t
+worker_nassigned(worker_t *w)
+{
+    return atomic_load_explicit(&w->nassigned, memory_order_relaxed);
+}
+
+/* Start measuring utilization afresh from now. */
+static void
+worker_utilization_reset(worker_t *self)
+{
+    self->load.mark_wall_ns = clock_ns(CLOCK_MONOTONIC);
+    self->load.mark_cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    self->load.busy_ticks = 0;
+}
+
+/* Once `utilization_period` has passed since the last mark, average
+ * the share of it that this thread was busy into the worker's
+ * utilization, and mark.  Busy time is the time spent servicing ready
+ * sessions, but no more than the CPU time the thread used, which
+ * leaves out any time that it was descheduled.  The CPU clock costs a
+ * system call, so read it only at a mark.
+ */
+static void
+worker_utilization_update(worker_t *self)
+{
+    load_t *load = &self->load;
+    const uint64_t wall = clock_ns(CLOCK_MONOTONIC);
+    uint64_t cpu, busy_ns, busy;
+
+    if (wall - load->mark_wall_ns < utilization_period)
+        return;
+
+    cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    busy_ns = (uint64_t) ((double) load->busy_ticks * stage_ns_per_tick());
+    if (busy_ns > cpu - load->mark_cpu_ns)
+        busy_ns = cpu - load->mark_cpu_ns;
+
+    busy = 256 * busy_ns / (wall - load->mark_wall_ns);
+    if (busy > 256)
+        busy = 256; // the clocks are read at slightly different times
+
+    load->utilization = (load->utilization + (uint_fast16_t) busy) / 2;
+    load->mark_wall_ns = wall;
+    load->mark_cpu_ns = cpu;
+    load->busy_ticks = 0;
+    load->marked = true;
+
+    hlog_fast(average, "%s: utilization %" PRIuFAST16 "/256", __func__,
+              load->utilization);
+}
+
+/* With -W, hand the sessions of a lightly loaded worker to the other
+ * running workers, so that it may park.  Only the last running worker
+ * parks, and only if the others have room for its sessions without
+ * reaching `pool_grow_utilization`.  Look once per utilization mark.
+ */
+static void
+worker_consolidate(worker_t *self)
+{
+    const size_t self_idx = (size_t) (self - &workers[0]);
+    const size_t nslots = arraycount(self->session) / 2;
+    size_t half, i, j, nroom = 0;
+
+    if (!global_state.pool.adaptive || !self->load.marked)
+        return;
+
+    self->load.marked = false;
+
+    if (worker_utilization(self) >= pool_shrink_utilization ||
+        worker_nassigned(self) == 0)
+        return;
+
+    if (pthread_mutex_trylock(&workers_mtx) == EBUSY)
+        return;
+
+    if (self_idx + 1 != nworkers_running || self_idx < global_state.pool.min ||
+        atomic_load_explicit(&self->inbox.tail, memory_order_relaxed) !=
+            self->inbox.head)
+        goto out;
+
+    for (j = 0; j < self_idx; j++) {
+        if (worker_utilization(&workers[j]) < pool_grow_utilization)
+            nroom += arraycount(workers[j].session) -
+                     worker_nassigned(&workers[j]);
+    }
+
+    if (nroom < worker_nassigned(self))
+        goto out;
+
+    hlog_fast(pool,
+              "%s: worker %p at utilization %" PRIuFAST16
+              "/256 hands off %zu sessions",
+              __func__, (void *) self, worker_utilization(self),
+              worker_nassigned(self));
+
+    for (half = 0; half < 2; half++) {
+        for (i = 0; i < nslots; i++) {
+            session_t *slot = &self->session[half * nslots + i];
+            session_t s = *slot;
+
+            if ((self->slots[half].occupied & (1U << i)) == 0)
+                continue;
+
+            worker_cq_forget(self, half, s.cxn);
+            s.cxn->parent = NULL;
+            slot->cxn = NULL;
+            self->slots[half].occupied &= ~(1U << i);
+            self->slots[half].pending &= ~(1U << i);
+            atomic_fetch_add_explicit(&self->nsessions[half], -1,
+                                      memory_order_relaxed);
+
+            for (j = 0; j < self_idx; j++) {
+                if (worker_utilization(&workers[j]) < pool_grow_utilization &&
+                    worker_assign_session(&workers[j], s))
+                    break;
+            }
+            assert(j < self_idx);
+
+            atomic_fetch_sub_explicit(&self->nassigned, 1,
+                                      memory_order_release);
+        }
+    }
+out:
+    (void) pthread_mutex_unlock(&workers_mtx);
+}
+
 static void
 worker_idle_loop(worker_t *self)
 {
@@ -3181,29 +5822,163 @@ worker_idle_loop(worker_t *self)
 static void
 worker_stats_log(worker_t *self)
 {
-    hlog_fast(worker_stats, "worker %p %" PRIu64 " epoll loops waitable",
-              (void *) self, self->stats.epoll_loops.waitable);
-    hlog_fast(worker_stats, "worker %p %" PRIu64 " epoll loops total",
-              (void *) self, self->stats.epoll_loops.total);
-    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops no I/O ready",
-              (void *) self, self->stats.half_loops.no_io_ready);
-    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops no session ready",
-              (void *) self, self->stats.half_loops.no_session_ready);
-    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops total",
-              (void *) self, self->stats.half_loops.total);
+    hlog_fast(worker_stats, "worker %p %" PRIu64 " epoll loops waitable",
+              (void *) self, self->stats->epoll_loops.waitable);
+    hlog_fast(worker_stats, "worker %p %" PRIu64 " epoll loops total",
+              (void *) self, self->stats->epoll_loops.total);
+    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops no I/O ready",
+              (void *) self, self->stats->half_loops.no_io_ready);
+    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops no session ready",
+              (void *) self, self->stats->half_loops.no_session_ready);
+    hlog_fast(worker_stats, "worker %p %" PRIu64 " half loops total",
+              (void *) self, self->stats->half_loops.total);
+}
+
+/* Start counting `perf_events` in user mode on the calling thread.
+ * Leave unavailable events' descriptors at -1.
+ */
+static void
+worker_perf_open(worker_t *self)
+{
+    size_t i;
+
+    for (i = 0; i < arraycount(perf_events); i++) {
+        struct perf_event_attr attr = {
+            .type = PERF_TYPE_HARDWARE,
+            .size = sizeof(attr),
+            .config = perf_events[i].config,
+            .read_format =
+                PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+            .exclude_kernel = 1,
+            .exclude_hv = 1};
+
+        self->perf.fd[i] =
+            (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (self->perf.fd[i] == -1) {
+            hlog_fast(err, "%s: worker %p could not count %s: %s", __func__,
+                      (void *) self, perf_events[i].name, strerror(errno));
+        }
+    }
+}
+
+/* Stop counting on the calling thread and record the counts, scaled
+ * up for any time that the kernel multiplexed the counters.
+ */
+static void
+worker_perf_close(worker_t *self)
+{
+    size_t i;
+
+    for (i = 0; i < arraycount(perf_events); i++) {
+        struct {
+            uint64_t value, enabled, running;
+        } rd;
+        const int fd = self->perf.fd[i];
+
+        if (fd == -1)
+            continue;
+
+        if (ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == -1 ||
+            read(fd, &rd, sizeof(rd)) != sizeof(rd)) {
+            hlog_fast(err, "%s: worker %p could not read %s: %s", __func__,
+                      (void *) self, perf_events[i].name, strerror(errno));
+            self->perf.fd[i] = -1;
+        } else if (rd.running != 0 && rd.running < rd.enabled) {
+            self->perf.count[i] = (uint64_t) ((double) rd.value *
+                                              (double) rd.enabled /
+                                              (double) rd.running);
+        } else {
+            self->perf.count[i] = rd.value;
+        }
+
+        (void) close(fd);
+    }
+}
+
+static void
+worker_perf_log(worker_t *self)
+{
+    const ptrdiff_t self_idx = self - &workers[0];
+    size_t i;
+
+    hlog_fast(perf, "worker %td: %" PRIu64 " bytes, %" PRIu64 " completions",
+              self_idx, self->totals.nbytes, self->totals.ncompletions);
+
+    for (i = 0; i < arraycount(perf_events); i++) {
+        const double count = (double) self->perf.count[i];
+
+        if (self->perf.fd[i] == -1)
+            continue;
+
+        hlog_fast(perf,
+                  "worker %td: %" PRIu64 " %s, %.4g per byte, "
+                  "%.4g per completion",
+                  self_idx, self->perf.count[i], perf_events[i].name,
+                  (self->totals.nbytes == 0)
+                      ? 0.
+                      : count / (double) self->totals.nbytes,
+                  (self->totals.ncompletions == 0)
+                      ? 0.
+                      : count / (double) self->totals.ncompletions);
+    }
+}
+
+/* Log the CPU time that `self` used per gigabyte that its sessions
+ * moved, the share of its wall-clock time that it was on a CPU, and
+ * the share of its half loops that found no work.
+ */
+static void
+worker_cpu_log(worker_t *self)
+{
+    const ptrdiff_t self_idx = self - &workers[0];
+    const uint64_t nhalf_loops =
+        atomic_load_explicit(&self->stats->half_loops.total,
+                             memory_order_relaxed);
+    const double cpu_s = (double) self->cpu.cpu_ns / 1e9,
+                 gb = (double) self->totals.nbytes / 1e9;
+
+    hlog_fast(cpu,
+              "worker %td: %.3f CPU s, %.3f GB, %.3f CPU s/GB, "
+              "%.1f%% on CPU, %.1f%% of %" PRIu64 " half loops idle",
+              self_idx, cpu_s, gb, (gb == 0.) ? 0. : cpu_s / gb,
+              (self->cpu.wall_ns == 0)
+                  ? 0.
+                  : 100. * (double) self->cpu.cpu_ns /
+                        (double) self->cpu.wall_ns,
+              (nhalf_loops == 0) ? 0.
+                                 : 100. * (double) self->cpu.nidle_half_loops /
+                                       (double) nhalf_loops,
+              nhalf_loops);
 }
 
 static void *
 worker_outer_loop(void *arg)
 {
     worker_t *self = arg;
+    const uint64_t wall_start = clock_ns(CLOCK_MONOTONIC),
+                   cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    if (global_state.perf)
+        worker_perf_open(self);
 
     while (!self->shutting_down) {
         worker_idle_loop(self);
+        if (global_state.pool.adaptive)
+            worker_utilization_reset(self);
         do {
             worker_run_loop(self);
+            if (global_state.pool.adaptive)
+                worker_utilization_update(self);
+            worker_consolidate(self);
         } while (!worker_is_idle(self) && !self->shutting_down);
     }
+
+    if (global_state.perf)
+        worker_perf_close(self);
+
+    self->cpu.wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+    self->cpu.cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
     return NULL;
 }
 
@@ -3219,7 +5994,7 @@ paybuflist_destroy(buflist_t *bl)
         if (!global_state.reregister && (rc = buf_mr_dereg(h)) != 0)
             warn_about_ofi_ret(rc, "fi_close");
 
-        free(h);
+        buf_free(h);
     }
     bl->nfull = bl->nallocated = 0;
     free(bl);
@@ -3262,12 +6037,9 @@ worker_init(worker_t *w)
     else if ((w->epoll_fd = epoll_create(1)) == -1)
         err(EXIT_FAILURE, "%s.%d: epoll_create", __func__, __LINE__);
 
-    w->pollable = true;
-    for (i = 0; i < arraycount(w->mtx); i++) {
-        if ((rc = pthread_mutex_init(&w->mtx[i], NULL)) != 0) {
-            errx(EXIT_FAILURE, "%s.%d: pthread_mutex_init: %s", __func__,
-                 __LINE__, strerror(rc));
-        }
+    /* With -R, the main thread reads the CQs directly. */
+    w->pollable = !global_state.run_to_completion;
+    for (i = 0; w->pollable && i < arraycount(w->pollset); i++) {
         if ((rc = fi_poll_open(global_state.domain, &attr, &w->pollset[i])) ==
             -FI_ENOSYS) {
             w->pollable = false;
@@ -3276,8 +6048,13 @@ worker_init(worker_t *w)
             bailout_for_ofi_ret(rc, "fi_poll_open");
         }
     }
-    for (i = 0; i < arraycount(w->session); i++)
+    for (i = 0; i < arraycount(w->session); i++) {
         w->session[i] = (session_t){.cxn = NULL, .terminal = NULL};
+        atomic_init(&w->inbox.full[i], false);
+    }
+    atomic_init(&w->inbox.tail, 0);
+    w->inbox.head = 0;
+    atomic_init(&w->nassigned, 0);
 
     w->paybufs.rx = worker_paybuflist_create(w, payload_access.rx);
     w->paybufs.tx = worker_paybuflist_create(w, payload_access.tx);
@@ -3286,10 +6063,31 @@ worker_init(worker_t *w)
                        .min_loop_contexts = INT_MAX,
                        .average = 0,
                        .loops_since_mark = 0,
-                       .ctxs_serviced_since_mark = 0};
-    w->stats = (worker_stats_t){
+                       .ctxs_serviced_since_mark = 0,
+                       .utilization = 0,
+                       .mark_wall_ns = 0,
+                       .mark_cpu_ns = 0,
+                       .busy_ticks = 0,
+                       .marked = false};
+    w->stats = &w->stats_private;
+    if (stats_segment != NULL) {
+        const size_t idx = (size_t) (w - &workers[0]);
+
+        w->stats = &stats_segment->worker[idx];
+        atomic_store_explicit(&stats_segment->nworkers, idx + 1,
+                              memory_order_relaxed);
+    }
+    *w->stats = (worker_stats_t){
         .epoll_loops = {.waitable = 0, .total = 0},
-        .half_loops = {.no_io_ready = 0, .no_session_ready = 0, .total = 0}};
+        .half_loops = {.no_io_ready = 0, .no_session_ready = 0, .total = 0},
+        .load_average = 0};
+    w->totals.nbytes = w->totals.ncompletions = 0;
+    w->totals.stages = (stage_times_t){.ticks = {0}, .ncalls = {0}};
+    w->cpu.wall_ns = w->cpu.cpu_ns = w->cpu.nidle_half_loops = 0;
+    for (i = 0; i < arraycount(w->perf.fd); i++) {
+        w->perf.fd[i] = -1;
+        w->perf.count[i] = 0;
+    }
 }
 
 static bool
@@ -3365,11 +6163,7 @@ worker_teardown(worker_t *w)
     int rc;
     size_t i;
 
-    for (i = 0; i < arraycount(w->mtx); i++) {
-        if ((rc = pthread_mutex_destroy(&w->mtx[i])) != 0) {
-            errx(EXIT_FAILURE, "%s.%d: pthread_mutex_destroy: %s",
-                __func__, __LINE__, strerror(rc));
-        }
+    for (i = 0; i < arraycount(w->pollset); i++) {
         if ((rc = fi_close(&w->pollset[i]->fid)) != 0)
             bailout_for_ofi_ret(rc, "fi_close");
     }
@@ -3390,7 +6184,8 @@ worker_create(void)
     worker_t *w;
 
     (void) pthread_mutex_lock(&workers_mtx);
-    w = (nworkers_allocated < arraycount(workers))
+    w = (nworkers_allocated < arraycount(workers) &&
+         nworkers_allocated < global_state.pool.max)
             ? &workers[nworkers_allocated++]
             : NULL;
     if (w != NULL)
@@ -3409,195 +6204,744 @@ worker_create(void)
                  __func__);
         }
 
-        nworkers_allocated--;
+        nworkers_allocated--;
+
+        (void) pthread_mutex_unlock(&workers_mtx);
+        return NULL;
+    }
+
+    return w;
+}
+
+static void
+workers_initialize(void)
+{
+}
+
+/* With -W, assign `s` to the running worker with the lowest
+ * utilization that has room for it.  Return NULL, so that another
+ * worker starts, if fewer than the minimum number of workers run, or
+ * if every candidate has reached `pool_grow_utilization` and the pool
+ * may still grow.  Caller must hold `workers_mtx`.
+ */
+static worker_t *
+workers_assign_session_by_utilization(session_t s)
+{
+    worker_t *best = NULL;
+    size_t i;
+
+    if (nworkers_running < global_state.pool.min)
+        return NULL;
+
+    for (i = 0; i < nworkers_running; i++) {
+        worker_t *w = &workers[i];
+
+        if (worker_nassigned(w) == arraycount(w->session))
+            continue;
+        if (best == NULL || worker_utilization(w) < worker_utilization(best))
+            best = w;
+    }
+
+    if (best == NULL || (worker_utilization(best) >= pool_grow_utilization &&
+                         nworkers_running < global_state.pool.max))
+        return NULL;
+
+    if (!worker_assign_session(best, s))
+        return NULL;
+
+    hlog_fast(pool, "%s: worker %p at utilization %" PRIuFAST16 "/256",
+              __func__, (void *) best, worker_utilization(best));
+
+    return best;
+}
+
+/* Try to allocate `c` to an active worker, least active, first.
+ * Caller must hold `workers_mtx`.
+ */
+static worker_t *
+workers_assign_session_to_running(session_t s)
+{
+    size_t iplus1;
+
+    if (global_state.pool.adaptive)
+        return workers_assign_session_by_utilization(s);
+
+    for (iplus1 = nworkers_running; 0 < iplus1; iplus1--) {
+        size_t i = iplus1 - 1;
+        worker_t *w = &workers[i];
+        if (worker_assign_session(w, s))
+            return w;
+    }
+    return NULL;
+}
+
+/* Try to assign `c` to the next idle worker servicing `dom`.
+ * Caller must hold `workers_mtx`.
+ */
+static worker_t *
+workers_assign_session_to_idle(session_t s)
+{
+    size_t i;
+
+    if ((i = nworkers_running) < nworkers_allocated &&
+        i < global_state.pool.max) {
+        worker_t *w = &workers[i];
+        if (worker_assign_session(w, s))
+            return w;
+    }
+    return NULL;
+}
+
+/* Try to wake the first idle worker.
+ *
+ * Caller must hold `workers_mtx`.
+ */
+static void
+workers_wake(worker_t *w)
+{
+    assert(&workers[nworkers_running] == w);
+    nworkers_running++;
+    pthread_cond_signal(&w->sleep);
+}
+
+static worker_t *
+workers_assign_session(session_t s)
+{
+    worker_t *w;
+
+    do {
+        (void) pthread_mutex_lock(&workers_mtx);
+
+        if (workers_assignment_suspended) {
+            (void) pthread_mutex_unlock(&workers_mtx);
+            return NULL;
+        }
+
+        if ((w = workers_assign_session_to_running(s)) != NULL)
+            ;
+        else if ((w = workers_assign_session_to_idle(s)) != NULL)
+            workers_wake(w);
+        (void) pthread_mutex_unlock(&workers_mtx);
+    } while (w == NULL && (w = worker_create()) != NULL);
+
+    return w;
+}
+
+/* Log the statistics of every worker once they have all stopped, and
+ * return the exit code of the program.
+ */
+static int
+workers_summarize(void)
+{
+    int code = EXIT_SUCCESS;
+    stage_times_t stages = {.ticks = {0}, .ncalls = {0}};
+    struct {
+        uint64_t cpu_ns, nbytes, nhalf_loops, nidle_half_loops;
+    } sum = {.cpu_ns = 0, .nbytes = 0, .nhalf_loops = 0, .nidle_half_loops = 0};
+    size_t i;
+
+    for (i = 0; i < nworkers_allocated; i++) {
+        worker_t *w = &workers[i];
+
+        if (w->failed || w->canceled != global_state.expect_cancellation)
+            code = EXIT_FAILURE;
+    }
+
+    for (i = 0; i < nworkers_allocated; i++) {
+        worker_t *w = &workers[i];
+        worker_stats_log(w);
+        if (global_state.perf)
+            worker_perf_log(w);
+        if (global_state.stages)
+            stage_times_add(&stages, &w->totals.stages);
+        if (global_state.cpu_report) {
+            worker_cpu_log(w);
+            sum.cpu_ns += w->cpu.cpu_ns;
+            sum.nbytes += w->totals.nbytes;
+            sum.nhalf_loops += atomic_load_explicit(
+                &w->stats->half_loops.total, memory_order_relaxed);
+            sum.nidle_half_loops += w->cpu.nidle_half_loops;
+        }
+    }
+
+    if (global_state.stages)
+        stage_times_log("all sessions", NULL, &stages);
+
+    if (global_state.cpu_report) {
+        const double cpu_s = (double) sum.cpu_ns / 1e9,
+                     gb = (double) sum.nbytes / 1e9;
+
+        hlog_fast(cpu,
+                  "all %zu workers (%s): %.3f CPU s, %.3f GB, "
+                  "%.3f CPU s/GB, %.1f%% of half loops idle",
+                  nworkers_allocated,
+                  global_state.waitfd ? "epoll wait" : "busy poll", cpu_s, gb,
+                  (gb == 0.) ? 0. : cpu_s / gb,
+                  (sum.nhalf_loops == 0)
+                      ? 0.
+                      : 100. * (double) sum.nidle_half_loops /
+                            (double) sum.nhalf_loops);
+    }
+
+    return code;
+}
+
+static int
+workers_join_all(void)
+{
+    size_t i;
+
+    (void) pthread_mutex_lock(&workers_mtx);
+
+    workers_assignment_suspended = true;
+
+    while (nworkers_running > 0) {
+        pthread_cond_wait(&nworkers_cond, &workers_mtx);
+    }
+
+    for (i = 0; i < nworkers_allocated; i++) {
+        worker_t *w = &workers[i];
+        w->shutting_down = true;
+        pthread_cond_signal(&w->sleep);
+    }
+
+    (void) pthread_mutex_unlock(&workers_mtx);
+
+    for (i = 0; i < nworkers_allocated; i++) {
+        worker_t *w = &workers[i];
+        int rc;
+
+        if ((rc = pthread_join(w->thd, NULL)) != 0) {
+            errx(EXIT_FAILURE, "%s.%d: pthread_join: %s", __func__, __LINE__,
+                 strerror(rc));
+        }
+    }
+
+    return workers_summarize();
+}
+
+/* With -R, service the `n` sessions at `sess` on the calling thread
+ * until they all end: no worker threads, locks, or poll sets, just
+ * `session_loop` reading each CQ directly.  The sessions borrow
+ * the payload buffers and statistics of one worker that never starts
+ * a thread.
+ */
+static int
+sessions_run_to_completion(session_t **sess, size_t n)
+{
+    worker_t *self = &workers[0];
+    const uint64_t wall_start = clock_ns(CLOCK_MONOTONIC),
+                   cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    size_t i, nleft = n;
+
+    (void) pthread_mutex_lock(&workers_mtx);
+    nworkers_allocated = 1;
+    worker_init(self);
+    (void) pthread_mutex_unlock(&workers_mtx);
+
+    self->thd = pthread_self();
+
+    for (i = 0; i < n; i++)
+        sess[i]->cxn->parent = sess[i];
+
+    if (global_state.perf)
+        worker_perf_open(self);
+
+    while (nleft > 0) {
+        for (i = 0; i < n; i++) {
+            session_t *s = sess[i];
+            cxn_t *c = s->cxn;
+
+            if (c == NULL)
+                continue;
+
+            if (global_state.weights.n != 0)
+                c->drr.deficit += c->drr.weight;
+
+            counter_add(&self->stats->half_loops.total, 1);
+
+            const loop_control_t ctl = session_loop(self, s);
+
+            if (global_state.weights.n != 0)
+                cxn_deficit_settle(c, !fifo_empty(s->ready_for_cxn));
+
+            switch (ctl) {
+                case loop_continue:
+                    continue;
+                case loop_end:
+                    break;
+                case loop_canceled:
+                    self->canceled = true;
+                    break;
+                case loop_error:
+                    self->failed = true;
+                    break;
+            }
+
+            self->totals.nbytes +=
+                atomic_load_explicit(&c->stats->nbytes, memory_order_relaxed);
+            self->totals.ncompletions += c->ncompletions;
+            if (global_state.stages) {
+                stage_times_log("session", (void *) s, &c->stages);
+                stage_times_add(&self->totals.stages, &c->stages);
+            }
+
+            if (!session_shutdown(s))
+                self->failed = true;
+            nleft--;
+        }
+    }
+
+    if (global_state.perf)
+        worker_perf_close(self);
+
+    self->cpu.wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+    self->cpu.cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    return workers_summarize();
+}
+
+/* Interrupt every running worker that may be blocked in epoll_pwait(2)
+ * so that it takes another pass over its sessions.
+ */
+static void
+workers_interrupt(void)
+{
+    size_t i;
+    int rc;
+
+    if (!global_state.waitfd)
+        return;
+
+    (void) pthread_mutex_lock(&workers_mtx);
+
+    for (i = 0; i < nworkers_running; i++) {
+        worker_t *w = &workers[i];
+
+        if ((rc = pthread_kill(w->thd, SIGUSR1)) != 0) {
+            errx(EXIT_FAILURE, "%s: could not signal thread for worker %p: %s",
+                 __func__, (void *) w, strerror(rc));
+        }
+    }
+
+    (void) pthread_mutex_unlock(&workers_mtx);
+}
+
+/* Make connection `c` visible to the monitor thread.  Only the main
+ * thread may call this, and it must do so before assigning `c`'s session
+ * to a worker.
+ */
+static void
+monitor_register(cxn_t *c)
+{
+    const size_t n =
+        atomic_load_explicit(&monitor.ncxns, memory_order_relaxed);
+
+    if (n == arraycount(monitor.cxn))
+        return;
+
+    c->watchdog.nbytes = 0;
+    c->watchdog.moved_at = clock_ns(CLOCK_MONOTONIC);
+    c->watchdog.reported = false;
+    c->report.counts = (cxn_counts_t){.nbytes = 0, .nwrites = 0, .nctlmsgs = 0};
+    c->report.closed = false;
+    c->report.window[0] = c->report.window[1] = c->report.counts;
+
+    if (n == 0)
+        monitor.epoch = c->watchdog.moved_at;
+
+    monitor.cxn[n] = c;
+    atomic_store_explicit(&monitor.ncxns, n + 1, memory_order_release);
+}
+
+/* Flag every open connection that has moved no bytes in the past
+ * `global_state.stall.interval` nanoseconds, counting from when it was
+ * registered.  A receiver is registered after it is accepted, and a
+ * transmitter after it is set up, so a connection that hangs before
+ * its first byte moves is flagged, too.  The worker servicing a
+ * flagged connection logs its state and, optionally, cancels it.
+ */
+static void
+watchdog_sample(uint64_t now)
+{
+    const size_t ncxns =
+        atomic_load_explicit(&monitor.ncxns, memory_order_acquire);
+    size_t i, nstalled = 0;
+
+    for (i = 0; i < ncxns; i++) {
+        cxn_t *c = monitor.cxn[i];
+        const uint64_t nbytes =
+            atomic_load_explicit(&c->stats->nbytes, memory_order_relaxed);
+
+        if (atomic_load_explicit(&c->stats->state, memory_order_relaxed) ==
+            FABTSTATS_SESSION_CLOSED)
+            continue;
+
+        if (nbytes != c->watchdog.nbytes) {
+            c->watchdog.nbytes = nbytes;
+            c->watchdog.moved_at = now;
+            c->watchdog.reported = false;
+            continue;
+        }
+
+        if (c->watchdog.reported ||
+            now - c->watchdog.moved_at < global_state.stall.interval)
+            continue;
 
-        (void) pthread_mutex_unlock(&workers_mtx);
-        return NULL;
+        hlog_fast(stall, "%s: connection %p moved no bytes in %.3f seconds",
+                  __func__, (void *) c,
+                  (double) (now - c->watchdog.moved_at) / 1e9);
+
+        c->watchdog.reported = true;
+        atomic_store_explicit(&c->stalled, true, memory_order_relaxed);
+        nstalled++;
     }
 
-    return w;
+    if (nstalled > 0)
+        workers_interrupt();
 }
 
-static void
-workers_initialize(void)
+static cxn_counts_t
+cxn_counts_sample(const cxn_stats_t *stats)
 {
+    return (cxn_counts_t){
+        .nbytes = atomic_load_explicit(&stats->nbytes, memory_order_relaxed),
+        .nwrites = atomic_load_explicit(&stats->nwrites, memory_order_relaxed),
+        .nctlmsgs =
+            atomic_load_explicit(&stats->nctlmsgs, memory_order_relaxed)};
 }
 
-static bool
-worker_assign_session(worker_t *w, session_t s)
+/* Print one throughput record for `session` (an index into
+ * `monitor.cxn[]`, "all", or "total"): `counts` accumulated over
+ * `elapsed` nanoseconds, ending `now`.  With -q, also print the
+ * `share` of the bytes that the session moved and its `target` share.
+ */
+static void
+report_print(uint64_t now, const char *session, cxn_counts_t counts,
+             uint64_t total_nbytes, uint64_t elapsed, uint64_t cxn_fifo,
+             uint64_t terminal_fifo, double share, double target)
+{
+    const double t = (double) (now - monitor.epoch) / 1e9,
+                 secs = (elapsed == 0) ? 1e-9 : (double) elapsed / 1e9;
+    const char *fmt =
+        global_state.report.json
+            ? "{\"time\": %.3f, \"session\": \"%s\", \"bytes\": %" PRIu64
+              ", \"bytes_per_s\": %.0f, \"writes_per_s\": %.0f, "
+              "\"ctlmsgs_per_s\": %.0f, \"ready_for_cxn\": %" PRIu64
+              ", \"ready_for_terminal\": %" PRIu64
+            : "%.3f,%s,%" PRIu64 ",%.0f,%.0f,%.0f,%" PRIu64 ",%" PRIu64;
+
+    printf(fmt, t, session, total_nbytes, (double) counts.nbytes / secs,
+           (double) counts.nwrites / secs, (double) counts.nctlmsgs / secs,
+           cxn_fifo, terminal_fifo);
+
+    if (global_state.weights.n != 0) {
+        printf(global_state.report.json
+                   ? ", \"share\": %.3f, \"target_share\": %.3f"
+                   : ",%.3f,%.3f",
+               share, target);
+    }
+
+    printf(global_state.report.json ? "}\n" : "\n");
+}
+
+/* Print per-session and aggregate throughput records for the interval
+ * since the previous report, if a report is due.  If `final`, print
+ * instead one "total" record covering every session since the first
+ * byte moved, or since the first one was registered if none did.
+ */
+static void
+report_sample(uint64_t now, bool final)
 {
-    size_t half, i;
-    int rc;
+    const size_t ncxns =
+        atomic_load_explicit(&monitor.ncxns, memory_order_acquire);
+    cxn_counts_t all = {.nbytes = 0, .nwrites = 0, .nctlmsgs = 0},
+                 total = all;
+    uint64_t cxn_fifo = 0, terminal_fifo = 0, nbytes = 0, weight = 0;
+    size_t i;
 
-    for (half = 0; half < 2; half++) {
-        pthread_mutex_t *mtx = &w->mtx[half];
+    if (ncxns == 0)
+        return;
+
+    if (!monitor.report.started) {
+        monitor.report.last = monitor.epoch;
+        monitor.report.due = monitor.epoch + global_state.report.interval;
+        monitor.report.started = true;
+        if (!global_state.report.json) {
+            printf("time,session,bytes,bytes_per_s,writes_per_s,"
+                   "ctlmsgs_per_s,ready_for_cxn,ready_for_terminal%s\n",
+                   (global_state.weights.n != 0) ? ",share,target_share" : "");
+        }
+    }
+
+    if (!final && now < monitor.report.due)
+        return;
 
-        if (pthread_mutex_trylock(mtx) == EBUSY)
+    /* With -q, find the bytes and the weight of the sessions in this
+     * interval, to compare each session's share with its target.
+     */
+    for (i = 0; !final && global_state.weights.n != 0 && i < ncxns; i++) {
+        cxn_t *c = monitor.cxn[i];
+
+        if (c->report.closed)
             continue;
 
-        // find an empty receiver slot
-        for (i = 0; i < arraycount(w->session) / 2; i++) {
-            session_t *slot =
-                &w->session[half * arraycount(w->session) / 2 + i];
+        nbytes += atomic_load_explicit(&c->stats->nbytes,
+                                       memory_order_relaxed) -
+                  c->report.counts.nbytes;
+        weight += c->drr.weight;
+    }
+
+    for (i = 0; i < ncxns; i++) {
+        cxn_t *c = monitor.cxn[i];
+        const cxn_counts_t cur = cxn_counts_sample(c->stats);
+        const cxn_counts_t delta = {
+            .nbytes = cur.nbytes - c->report.counts.nbytes,
+            .nwrites = cur.nwrites - c->report.counts.nwrites,
+            .nctlmsgs = cur.nctlmsgs - c->report.counts.nctlmsgs};
+        const uint64_t cfifo =
+            atomic_load_explicit(&c->stats->cxn_fifo, memory_order_relaxed);
+        const uint64_t tfifo = atomic_load_explicit(&c->stats->terminal_fifo,
+                                                    memory_order_relaxed);
+        const bool was_closed = c->report.closed;
+        char session[32];
+
+        /* With -D, the total covers only the measurement window. */
+        if (final && monitor.window.begin != 0) {
+            const cxn_counts_t *begin = &c->report.window[0],
+                               *end = (monitor.window.end != 0)
+                                          ? &c->report.window[1]
+                                          : &cur;
+
+            total.nbytes += end->nbytes - begin->nbytes;
+            total.nwrites += end->nwrites - begin->nwrites;
+            total.nctlmsgs += end->nctlmsgs - begin->nctlmsgs;
+            continue;
+        }
 
-            if (slot->cxn != NULL)
-                continue;
+        total.nbytes += cur.nbytes;
+        total.nwrites += cur.nwrites;
+        total.nctlmsgs += cur.nctlmsgs;
 
-            *slot = s;
-            slot->cxn->parent = slot;
+        if (final)
+            continue;
 
-            rc = w->pollable ? fi_poll_add(w->pollset[half], &s.cxn->cq->fid, 0)
-                             : 0;
+        all.nbytes += delta.nbytes;
+        all.nwrites += delta.nwrites;
+        all.nctlmsgs += delta.nctlmsgs;
 
-            if (rc != 0)
-                bailout_for_ofi_ret(rc, "fi_poll_add");
+        c->report.counts = cur;
+        c->report.closed =
+            atomic_load_explicit(&c->stats->state, memory_order_relaxed) ==
+            FABTSTATS_SESSION_CLOSED;
 
-            if (!global_state.waitfd)
-                ;
-            else if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, s.cxn->cq_wait_fd,
-                               &(struct epoll_event){
-                                   .events = EPOLLIN,
-                                   .data = {.ptr = slot->cxn}}) == -1) {
-                err(EXIT_FAILURE, "%s.%d: epoll_ctl(,EPOLL_CTL_ADD,)", __func__,
-                    __LINE__);
-            }
+        /* Report a session through the interval when it closes. */
+        if (was_closed)
+            continue;
 
-            atomic_fetch_add_explicit(&w->nsessions[half], 1,
-                                      memory_order_relaxed);
+        cxn_fifo += cfifo;
+        terminal_fifo += tfifo;
 
-            (void) pthread_mutex_unlock(mtx);
-            return true;
-        }
-        (void) pthread_mutex_unlock(mtx);
-    }
-    if (global_state.waitfd && (rc = pthread_kill(w->thd, SIGUSR1)) != 0) {
-        errx(EXIT_FAILURE, "%s: could not signal thread for worker %p: %s",
-             __func__, (void *) w, strerror(rc));
+        (void) snprintf(session, sizeof(session), "%zu", i);
+        report_print(now, session, delta, cur.nbytes,
+                     now - monitor.report.last, cfifo, tfifo,
+                     (nbytes == 0) ? 0 : (double) delta.nbytes / nbytes,
+                     (weight == 0) ? 0 : (double) c->drr.weight / weight);
     }
-    return false;
-}
 
-/* Try to allocate `c` to an active worker, least active, first.
- * Caller must hold `workers_mtx`.
- */
-static worker_t *
-workers_assign_session_to_running(session_t s)
-{
-    size_t iplus1;
+    if (final && monitor.window.begin != 0) {
+        report_print(now, "total", total, total.nbytes,
+                     ((monitor.window.end != 0) ? monitor.window.end : now) -
+                         monitor.window.begin,
+                     0, 0, 1, 1);
+    } else if (final) {
+        const uint64_t first_byte =
+            atomic_load_explicit(&monitor.first_byte, memory_order_relaxed);
 
-    for (iplus1 = nworkers_running; 0 < iplus1; iplus1--) {
-        size_t i = iplus1 - 1;
-        worker_t *w = &workers[i];
-        if (worker_assign_session(w, s))
-            return w;
+        report_print(now, "total", total, total.nbytes,
+                     now - ((first_byte != 0) ? first_byte : monitor.epoch),
+                     0, 0, 1, 1);
+    } else {
+        report_print(now, "all", all, total.nbytes, now - monitor.report.last,
+                     cxn_fifo, terminal_fifo, 1, 1);
+        monitor.report.last = now;
+        while (monitor.report.due <= now)
+            monitor.report.due += global_state.report.interval;
     }
-    return NULL;
+
+    (void) fflush(stdout);
 }
 
-/* Try to assign `c` to the next idle worker servicing `dom`.
- * Caller must hold `workers_mtx`.
+/* With -D, open the measurement window once the warm-up is over, and
+ * close it after its length, recording the counters of every
+ * connection each time.  When the window closes, tell the sources to
+ * end their streams.  The warm-up starts when the first byte moves, so
+ * that on both ends it excludes waiting for the peer and connecting.
  */
-static worker_t *
-workers_assign_session_to_idle(session_t s)
+static void
+window_sample(uint64_t now)
 {
+    const size_t ncxns =
+        atomic_load_explicit(&monitor.ncxns, memory_order_acquire);
+    const uint64_t first_byte =
+        atomic_load_explicit(&monitor.first_byte, memory_order_relaxed);
+    const bool opening = (monitor.window.begin == 0);
     size_t i;
 
-    if ((i = nworkers_running) < nworkers_allocated) {
-        worker_t *w = &workers[i];
-        if (worker_assign_session(w, s))
-            return w;
+    if (ncxns == 0 || first_byte == 0 || monitor.window.end != 0)
+        return;
+
+    if (opening && now < first_byte + global_state.duration.warmup)
+        return;
+
+    if (!opening && now < monitor.window.begin + global_state.duration.length)
+        return;
+
+    for (i = 0; i < ncxns; i++) {
+        cxn_t *c = monitor.cxn[i];
+
+        c->report.window[opening ? 0 : 1] = cxn_counts_sample(c->stats);
     }
-    return NULL;
-}
 
-/* Try to wake the first idle worker.
- *
- * Caller must hold `workers_mtx`.
- */
-static void
-workers_wake(worker_t *w)
-{
-    assert(&workers[nworkers_running] == w);
-    nworkers_running++;
-    pthread_cond_signal(&w->sleep);
+    if (opening) {
+        monitor.window.begin = now;
+        hlog_fast(window, "%s: measurement window opened", __func__);
+        return;
+    }
+
+    monitor.window.end = now;
+    hlog_fast(window, "%s: measurement window closed", __func__);
+    atomic_store_explicit(&global_state.duration.over, true,
+                          memory_order_relaxed);
 }
 
-static worker_t *
-workers_assign_session(session_t s)
+static void *
+monitor_loop(void transfer_unused *arg)
 {
-    worker_t *w;
+    struct timespec deadline;
+    uint64_t next = clock_ns(CLOCK_MONOTONIC);
+    int rc;
 
-    do {
-        (void) pthread_mutex_lock(&workers_mtx);
+    (void) pthread_mutex_lock(&monitor.mtx);
 
-        if (workers_assignment_suspended) {
-            (void) pthread_mutex_unlock(&workers_mtx);
-            return NULL;
+    while (!monitor.stopping) {
+        next += monitor.period;
+        deadline = (struct timespec){.tv_sec = next / 1000000000,
+                                     .tv_nsec = next % 1000000000};
+
+        rc = 0;
+        while (!monitor.stopping && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&monitor.wakeup, &monitor.mtx,
+                                        &deadline);
         }
 
-        if ((w = workers_assign_session_to_running(s)) != NULL)
-            ;
-        else if ((w = workers_assign_session_to_idle(s)) != NULL)
-            workers_wake(w);
-        (void) pthread_mutex_unlock(&workers_mtx);
-    } while (w == NULL && (w = worker_create()) != NULL);
+        if (monitor.stopping)
+            break;
 
-    return w;
+        (void) pthread_mutex_unlock(&monitor.mtx);
+
+        const uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+        if (global_state.stall.interval != 0)
+            watchdog_sample(now);
+
+        if (global_state.duration.length != 0)
+            window_sample(now);
+
+        if (global_state.report.interval != 0)
+            report_sample(now, false);
+
+        (void) pthread_mutex_lock(&monitor.mtx);
+    }
+
+    (void) pthread_mutex_unlock(&monitor.mtx);
+
+    return NULL;
 }
 
-static int
-workers_join_all(void)
+/* Start the monitor thread if any feature needs it.  The caller should
+ * block the signals that only the cancellation thread and the workers
+ * may handle.
+ */
+static void
+monitor_start(void)
 {
-    int code = EXIT_SUCCESS;
-    size_t i;
-
-    (void) pthread_mutex_lock(&workers_mtx);
+    pthread_condattr_t attr;
+    int rc;
 
-    workers_assignment_suspended = true;
+    if (global_state.stall.interval == 0 && global_state.report.interval == 0 &&
+        global_state.duration.length == 0)
+        return;
 
-    while (nworkers_running > 0) {
-        pthread_cond_wait(&nworkers_cond, &workers_mtx);
+    /* Sample often enough to catch a stall within 1.25 intervals and
+     * to report throughput on time.
+     */
+    monitor.period = UINT64_MAX;
+    if (global_state.stall.interval != 0)
+        monitor.period = global_state.stall.interval / 4;
+    if (global_state.report.interval != 0 &&
+        global_state.report.interval < monitor.period)
+        monitor.period = global_state.report.interval;
+    /* Open and close the -D window within 10 milliseconds. */
+    if (global_state.duration.length != 0 && 10000000 < monitor.period)
+        monitor.period = 10000000;
+    if (monitor.period < 1000000)
+        monitor.period = 1000000;
+
+    if ((rc = pthread_condattr_init(&attr)) != 0 ||
+        (rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) != 0 ||
+        (rc = pthread_cond_init(&monitor.wakeup, &attr)) != 0) {
+        errx(EXIT_FAILURE, "%s.%d: pthread_cond_init: %s", __func__, __LINE__,
+             strerror(rc));
     }
+    (void) pthread_condattr_destroy(&attr);
 
-    for (i = 0; i < nworkers_allocated; i++) {
-        worker_t *w = &workers[i];
-        w->shutting_down = true;
-        pthread_cond_signal(&w->sleep);
+    monitor.stopping = false;
+
+    if ((rc = pthread_create(&monitor.thd, NULL, monitor_loop, NULL)) != 0) {
+        errx(EXIT_FAILURE, "%s.%d: pthread_create: %s", __func__, __LINE__,
+             strerror(rc));
     }
 
-    (void) pthread_mutex_unlock(&workers_mtx);
+    monitor.running = true;
+}
 
-    for (i = 0; i < nworkers_allocated; i++) {
-        worker_t *w = &workers[i];
-        int rc;
+static void
+monitor_stop(void)
+{
+    int rc;
 
-        if ((rc = pthread_join(w->thd, NULL)) != 0) {
-            errx(EXIT_FAILURE, "%s.%d: pthread_join: %s", __func__, __LINE__,
-                 strerror(rc));
-        }
-        if (w->failed || w->canceled != global_state.expect_cancellation)
-            code = EXIT_FAILURE;
-    }
+    if (!monitor.running)
+        return;
 
-    for (i = 0; i < nworkers_allocated; i++) {
-        worker_t *w = &workers[i];
-        worker_stats_log(w);
+    (void) pthread_mutex_lock(&monitor.mtx);
+    monitor.stopping = true;
+    (void) pthread_cond_signal(&monitor.wakeup);
+    (void) pthread_mutex_unlock(&monitor.mtx);
+
+    if ((rc = pthread_join(monitor.thd, NULL)) != 0) {
+        errx(EXIT_FAILURE, "%s.%d: pthread_join: %s", __func__, __LINE__,
+             strerror(rc));
     }
 
-    return code;
+    monitor.running = false;
+
+    if (global_state.report.interval != 0)
+        report_sample(clock_ns(CLOCK_MONOTONIC), true);
 }
 
 static void
 cxn_init(cxn_t *c, struct fid_av *av,
          loop_control_t (*loop)(worker_t *, session_t *),
          void (*cancel)(cxn_t *), bool (*cancellation_complete)(cxn_t *),
-         void (*shutdown)(cxn_t *))
+         void (*shutdown)(cxn_t *), void (*dump)(cxn_t *))
 {
     memset(c, 0, sizeof(*c));
     c->magic = 0xdeadbeef;
     c->cancel = cancel;
     c->cancellation_complete = cancellation_complete;
     c->shutdown = shutdown;
+    c->dump = dump;
     c->loop = loop;
     c->av = av;
     c->sent_first = false;
@@ -3605,12 +6949,55 @@ cxn_init(cxn_t *c, struct fid_av *av,
     c->cancelled = false;
     c->eof.local = c->eof.remote = false;
     seqsource_init(&c->keys);
+    c->stalled = false;
+    c->stats = &c->stats_private;
+    if (stats_segment != NULL) {
+        const uint64_t slot = atomic_fetch_add_explicit(
+            &stats_segment->nsessions, 1, memory_order_relaxed);
+
+        if (slot < arraycount(stats_segment->session))
+            c->stats = &stats_segment->session[slot];
+    }
+    *c->stats = (cxn_stats_t){.state = FABTSTATS_SESSION_OPEN,
+                              .nbytes = 0,
+                              .nwrites = 0,
+                              .nctlmsgs = 0,
+                              .cxn_fifo = 0,
+                              .terminal_fifo = 0};
+}
+
+/* Release the vectors that arrived ahead of their turn and are still
+ * parked when the session ends, as it may after a cancellation or a
+ * protocol error.  With -M they are copies, and go back to the pool.
+ */
+static void
+xmtr_vecseq_drain(xmtr_t *x)
+{
+    size_t i;
+
+    for (i = 0; i < arraycount(x->vecseq.early); i++) {
+        bufhdr_t *h = x->vecseq.early[i];
+
+        if (h == NULL)
+            continue;
+
+        x->vecseq.early[i] = NULL;
+
+        if (global_state.multi_recv && buflist_put(x->vec.pool, h))
+            continue;
+
+        (void) buf_mr_dereg(h);
+        buf_free(h);
+    }
 }
 
 void
 xmtr_shutdown(cxn_t *c)
 {
     xmtr_t *x = (xmtr_t *) c;
+
+    xmtr_vecseq_drain(x);
+
     if (fi_close(&x->initial.mr->fid) < 0)
         hlog_fast(err, "%s: could not close initial MR", __func__);
     if (fi_close(&x->ack.mr->fid) < 0)
@@ -3675,13 +7062,20 @@ xmtr_init(xmtr_t *x, struct fid_av *av)
     x->bytes_progress = 0;
 
     cxn_init(&x->cxn, av, xmtr_loop, xmtr_cancel, xmtr_cancellation_complete,
-             xmtr_shutdown);
+             xmtr_shutdown, xmtr_dump);
     xmtr_memory_init(x);
+    /* The scoreboard has one entry, and one bit in each mask, for each
+     * posted write.
+     */
+    if (maxposted > arraycount(x->wrsb.nbytes)) {
+        errx(EXIT_FAILURE, "%s: %zu posted writes overflow the %zu-entry "
+             "scoreboard", __func__, maxposted, arraycount(x->wrsb.nbytes));
+    }
     if ((x->wrposted = fifo_create(maxposted)) == NULL) {
         errx(EXIT_FAILURE, "%s: could not create posted RDMA writes FIFO",
              __func__);
     }
-    rxctl_init(&x->vec, 64);
+    rxctl_init(&x->vec, 64, xft_vector, sizeof(vector_msg_t));
 }
 
 /* Second stage initialization needs an endpoint (x->cxn.ep). */
@@ -3693,6 +7087,14 @@ xmtr_buffers_init(xmtr_t *x)
 
     txctl_init(&x->progress, 64, 16, progbuf_create_and_register, x->cxn.ep);
 
+    /* A progress message must not overtake the RDMA writes that it
+     * reports.  FI_DELIVERY_COMPLETE writes have landed before they
+     * retire.  FI_TRANSMIT_COMPLETE writes may not have, so fence the
+     * progress messages unless the provider orders sends after writes.
+     */
+    if (global_state.progress_fence)
+        x->progress.flags = FI_FENCE;
+
     if ((x->fragment.pool = buflist_create(maxposted)) == NULL) {
         errx(EXIT_FAILURE, "%s: could not create fragment header pool",
              __func__);
@@ -3711,6 +7113,8 @@ terminal_init(terminal_t *t,
               loop_control_t (*trade)(terminal_t *, fifo_t *, fifo_t *))
 {
     t->trade = trade;
+    t->shutdown = NULL;
+    t->nheld = 0;
 }
 
 static void
@@ -3719,18 +7123,254 @@ sink_init(sink_t *s)
     memset(s, 0, sizeof(*s));
     terminal_init(&s->terminal, sink_trade);
     s->txbuflen = strlen(txbuf);
-    s->entirelen = s->txbuflen * (size_t) 100000;
+    s->entirelen = (global_state.duration.length != 0)
+                       ? SIZE_MAX
+                       : s->txbuflen * (size_t) 100000;
+    s->idx = 0;
+}
+
+/* Set up the source for session `i`.  Each session draws buffer sizes
+ * from its own sequence.
+ */
+static void
+source_init(source_t *s, size_t i)
+{
+    memset(s, 0, sizeof(*s));
+    terminal_init(&s->terminal, source_trade);
+    s->txbuflen = strlen(txbuf);
+    s->entirelen = (global_state.duration.length != 0)
+                       ? SIZE_MAX
+                       : s->txbuflen * (size_t) 100000;
     s->idx = 0;
+    s->rng = global_state.sizes.seed + i;
+}
+
+/* Wait for the I/O in flight to finish, then release the ring and the
+ * file.  A sink flushes the file first so that the transfer is not done
+ * until the bytes are on storage.
+ */
+static bool
+file_terminal_shutdown(terminal_t *t)
+{
+    file_terminal_t *f = (file_terminal_t *) t;
+    struct io_uring_cqe cqe;
+    bool ok = true;
+
+    while (f->ring.ninflight != 0) {
+        if (syscall(SYS_io_uring_enter, f->ring.fd, f->ring.nqueued,
+                    f->ring.ninflight, IORING_ENTER_GETEVENTS, NULL,
+                    0) == -1 &&
+            errno != EINTR)
+            err(EXIT_FAILURE, "%s: io_uring_enter", __func__);
+        f->ring.nqueued = 0;
+        while (uring_reap(&f->ring, &cqe))
+            ;
+    }
+
+    /* The bytes are not known to be in the file until fsync(2)
+     * succeeds, so a failure there fails the session.
+     */
+    if (f->terminal.trade == file_sink_trade && fsync(f->fd) == -1) {
+        hlog_fast(err, "%s: fsync: %s", __func__, strerror(errno));
+        ok = false;
+    }
+
+    uring_destroy(&f->ring);
+
+    if (close(f->fd) == -1)
+        hlog_fast(leak, "%s: close: %s", __func__, strerror(errno));
+
+    return ok;
+}
+
+static void
+filter_init(filter_t *f, size_t kind)
+{
+    memset(f, 0, sizeof(*f));
+    terminal_init(&f->terminal, filter_trade);
+    f->name = filter_kinds[kind].name;
+    f->apply = filter_kinds[kind].apply;
+    f->adler[0] = 1;
+
+    if (f->apply == filter_decompress_apply)
+        f->terminal.trade = lz_trade;
+
+    if (f->apply == filter_compress_apply) {
+        f->terminal.trade = lz_trade;
+        f->lz.table = calloc((size_t) 1 << LZ_HASH_BITS, sizeof(*f->lz.table));
+        if (f->lz.table == NULL)
+            err(EXIT_FAILURE, "%s: calloc", __func__);
+    }
+}
+
+/* Log what passed through each filter and how long the filter took,
+ * then release the stages and the FIFOs between them.
+ */
+static bool
+chain_shutdown(terminal_t *t)
+{
+    chain_t *c = (chain_t *) t;
+    const double ns_per_tick = stage_ns_per_tick();
+    bufhdr_t *h;
+    bool ok = true;
+    size_t i;
+
+    for (i = 0; i < c->nstages; i++) {
+        terminal_t *stage = c->stage[i];
+
+        if (stage->shutdown != NULL && !stage->shutdown(stage))
+            ok = false;
+    }
+
+    for (i = 0; i < global_state.filters.n; i++) {
+        const filter_t *f = &c->filter[i];
+        const double ns = (double) f->ticks * ns_per_tick;
+
+        hlog_fast(filter,
+                  "%s: chain %p filter %s: %" PRIu64 " bytes, %" PRIu64
+                  " buffers, %.3f ms, %.1f MB/s",
+                  __func__, (void *) c, f->name, f->nbytes, f->nbufs,
+                  ns / 1e6, (ns == 0) ? 0. : (double) f->nbytes * 1e3 / ns);
+        if (f->apply == filter_adler32_apply) {
+            hlog_fast(filter, "%s: chain %p filter %s: %08" PRIx32,
+                      __func__, (void *) c, f->name,
+                      (f->adler[1] << 16) | f->adler[0]);
+        }
+        if (f->terminal.trade == lz_trade) {
+            hlog_fast(filter,
+                      "%s: chain %p filter %s: %" PRIu64 " bytes out, "
+                      "%.1f%% of the input",
+                      __func__, (void *) c, f->name, f->nbytes_out,
+                      (f->nbytes == 0) ? 0. : 100. * (double) f->nbytes_out /
+                                                 (double) f->nbytes);
+        }
+        free(f->lz.staged);
+        free(f->lz.in);
+        free(f->lz.table);
+    }
+
+    for (i = 0; i + 1 < c->nstages; i++) {
+        while ((h = fifo_alt_get(c->between[i])) != NULL) {
+            buf_mr_dereg(h);
+            buf_free(h);
+        }
+        fifo_destroy(c->between[i]);
+    }
+    return ok;
+}
+
+/* Run terminal `end` with the filters that -F selects: after `end` if
+ * it is a source, before `end` if it is a sink.
+ */
+static void
+chain_init(chain_t *c, terminal_t *end, bool sink)
+{
+    size_t i;
+
+    memset(c, 0, sizeof(*c));
+    terminal_init(&c->terminal, chain_trade);
+    c->terminal.shutdown = chain_shutdown;
+    c->sink = sink;
+
+    if (!sink)
+        c->stage[c->nstages++] = end;
+
+    for (i = 0; i < global_state.filters.n; i++) {
+        filter_init(&c->filter[i], global_state.filters.kind[i]);
+        c->stage[c->nstages++] = &c->filter[i].terminal;
+    }
+
+    if (sink)
+        c->stage[c->nstages++] = end;
+
+    for (i = 0; i + 1 < c->nstages; i++) {
+        if ((c->between[i] = fifo_create(64)) == NULL)
+            errx(EXIT_FAILURE, "%s: could not create a FIFO", __func__);
+    }
+}
+
+/* Restore the file status flags of standard output, which the
+ * terminal or the pipe may share with other processes.
+ */
+static bool
+stream_terminal_shutdown(terminal_t *t)
+{
+    stream_terminal_t *st = (stream_terminal_t *) t;
+
+    if (fcntl(st->fd, F_SETFL, st->flags) == -1)
+        hlog_fast(err, "%s: fcntl: %s", __func__, strerror(errno));
+
+    return true;
+}
+
+/* Set up a terminal that reads standard input (`sink` false) or writes
+ * standard output (`sink` true) for the only session.  The sink makes
+ * standard output non-blocking, so that a slow reader never blocks
+ * the worker in writev(2).
+ */
+static void
+stream_terminal_init(stream_terminal_t *st, bool sink)
+{
+    struct stat sb;
+
+    memset(st, 0, sizeof(*st));
+    terminal_init(&st->terminal,
+                  sink ? stream_sink_trade : stream_source_trade);
+    st->fd = global_state.stream_fd;
+
+    if (fstat(st->fd, &sb) == -1)
+        err(EXIT_FAILURE, "%s: fstat", __func__);
+
+    st->pipe = S_ISFIFO(sb.st_mode);
+
+    if (!sink)
+        return;
+
+    st->terminal.shutdown = stream_terminal_shutdown;
+
+    if ((st->flags = fcntl(st->fd, F_GETFL)) == -1 ||
+        fcntl(st->fd, F_SETFL, st->flags | O_NONBLOCK) == -1)
+        err(EXIT_FAILURE, "%s: fcntl", __func__);
 }
 
+/* Open the file that session `i` of `n` reads (`sink` false) or writes
+ * (`sink` true): the -f path itself if there is only one session,
+ * otherwise the path with `.i` appended.
+ */
 static void
-source_init(source_t *s)
+file_terminal_init(file_terminal_t *f, bool sink, size_t i, size_t n)
 {
-    memset(s, 0, sizeof(*s));
-    terminal_init(&s->terminal, source_trade);
-    s->txbuflen = strlen(txbuf);
-    s->entirelen = s->txbuflen * (size_t) 100000;
-    s->idx = 0;
+    char path[PATH_MAX];
+    const char *name = global_state.file_path;
+    const int flags = sink ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+
+    memset(f, 0, sizeof(*f));
+    terminal_init(&f->terminal, sink ? file_sink_trade : file_source_trade);
+    f->terminal.shutdown = file_terminal_shutdown;
+
+    if (n > 1) {
+        if (snprintf(path, sizeof(path), "%s.%zu", name, i) >=
+            (int) sizeof(path))
+            errx(EXIT_FAILURE, "%s: path `%s.%zu` too long", __func__, name,
+                 i);
+        name = path;
+    }
+
+    /* Page-aligned buffers can bypass the page cache, if the file
+     * system allows.
+     */
+    if (payload_page_aligned()) {
+        f->fixed.enabled = true;
+        if ((f->fd = open(name, flags | O_DIRECT, 0644)) != -1)
+            f->direct = true;
+        else if (errno != EINVAL)
+            err(EXIT_FAILURE, "%s: open(\"%s\")", __func__, name);
+    }
+
+    if (!f->direct && (f->fd = open(name, flags, 0644)) == -1)
+        err(EXIT_FAILURE, "%s: open(\"%s\")", __func__, name);
+
+    uring_init(&f->ring, global_state.file_depth);
 }
 
 static void
@@ -3824,14 +7464,14 @@ rcvr_init(rcvr_t *r, struct fid_ep *listen_ep, struct fid_av *av)
     memset(r, 0, sizeof(*r));
 
     cxn_init(&r->cxn, av, rcvr_loop, rcvr_cancel, rcvr_cancellation_complete,
-             rcvr_shutdown);
+             rcvr_shutdown, rcvr_dump);
     rcvr_initial_msg_init(r, listen_ep);
 
     if ((r->tgtposted = fifo_create(64)) == NULL) {
         errx(EXIT_FAILURE, "%s: could not create RDMA targets FIFO", __func__);
     }
 
-    rxctl_init(&r->progress, 64);
+    rxctl_init(&r->progress, 64, xft_progress, sizeof(progress_msg_t));
 }
 
 static void
@@ -3863,12 +7503,35 @@ post_initial_rx(struct fid_ep *ep, get_session_t *gs)
         bailout_for_ofi_ret(rc, "fi_recvmsg");
 }
 
+/* With -M, tell the provider to release a multi-receive buffer on `ep`
+ * when it has less room left than a `msglen`-byte message needs.
+ */
+static void
+ep_multi_recv_setopt(struct fid_ep *ep, size_t msglen)
+{
+    int rc;
+
+    if (!global_state.multi_recv)
+        return;
+
+    rc = fi_setopt(&ep->fid, FI_OPT_ENDPOINT, FI_OPT_MIN_MULTI_RECV, &msglen,
+                   sizeof(msglen));
+
+    if (rc != 0)
+        bailout_for_ofi_ret(rc, "fi_setopt(,,FI_OPT_MIN_MULTI_RECV,)");
+}
+
 static get_session_t *
 get_session_accept(get_state_t *gst)
 {
+    /* With -M, the CQ must report where each message landed in its
+     * multi-receive buffer.
+     */
     struct fi_cq_attr cq_attr = {.size = 128,
                                  .flags = 0,
-                                 .format = FI_CQ_FORMAT_MSG,
+                                 .format = global_state.multi_recv
+                                               ? FI_CQ_FORMAT_DATA
+                                               : FI_CQ_FORMAT_MSG,
                                  .wait_obj = global_state.waitfd ? FI_WAIT_FD
                                                                  : FI_WAIT_NONE,
                                  .signaling_vector = 0,
@@ -3916,11 +7579,23 @@ get_session_accept(get_state_t *gst)
     }
 
     if (r->initial.msg.nsources != global_state.total_sessions ||
-        r->initial.msg.id > global_state.total_sessions) {
+        r->initial.msg.id >= global_state.total_sessions) {
         errx(EXIT_FAILURE,
-             "received nsources %" PRIu32 ", id %" PRIu32 ", expected %zu, 0",
+             "received nsources %" PRIu32 ", id %" PRIu32
+             ", expected %zu, less than %zu",
              r->initial.msg.nsources, r->initial.msg.id,
-             global_state.total_sessions);
+             global_state.total_sessions, global_state.total_sessions);
+    }
+
+    /* A sink that expects a fixed length fails on a time-bounded
+     * stream, and a time-bounded sink measures a window that the
+     * transmitter does not keep to.
+     */
+    if ((r->initial.msg.timed != 0) != (global_state.duration.length != 0)) {
+        errx(EXIT_FAILURE, "fabtput %s `-D` but fabtget %s; give both "
+             "ends the same `-D`",
+             (r->initial.msg.timed != 0) ? "has" : "does not have",
+             (global_state.duration.length != 0) ? "does" : "does not");
     }
 
     rc = fi_av_insert(r->cxn.av, r->initial.msg.addr, 1, &r->cxn.peer_addr, 0,
@@ -3946,6 +7621,8 @@ get_session_accept(get_state_t *gst)
     if ((rc = fi_endpoint(global_state.domain, ep_info, &r->cxn.ep, NULL)) < 0)
         bailout_for_ofi_ret(rc, "fi_endpoint");
 
+    ep_multi_recv_setopt(r->cxn.ep, sizeof(progress_msg_t));
+
     hints->dest_addr = NULL; // fi_freeinfo wants to free(3) dest_addr
     hints->dest_addrlen = 0;
     fi_freeinfo(hints);
@@ -4250,10 +7927,14 @@ get(void)
     sink_t *s;
     get_session_t *gs;
     worker_t *w;
+    bool *named; // named[i]: a file is open for transmit session i
     size_t i;
 
     gst = get_state_open();
 
+    if ((named = calloc(global_state.total_sessions, sizeof(*named))) == NULL)
+        err(EXIT_FAILURE, "%s: calloc", __func__);
+
     for (i = 0; i < global_state.total_sessions; i++) {
         gs = &gst->session[i];
 
@@ -4274,19 +7955,67 @@ get(void)
 
         rcvr_ack_msg_init(r, r->cxn.ep);
         rcvr_buffers_init(r);
-        if (!session_init(&gs->sess, &r->cxn, &s->terminal))
+
+        terminal_t *t = &s->terminal;
+
+        if (global_state.file_path != NULL &&
+            strcmp(global_state.file_path, "-") == 0) {
+            stream_terminal_init(&gs->stream, true);
+            t = &gs->stream.terminal;
+        } else if (global_state.file_path != NULL) {
+            /* Name the file after the transmitter's session, not the
+             * order of arrival, so that both ends name it alike.
+             */
+            const uint32_t id = r->initial.msg.id;
+
+            if (named[id]) {
+                errx(EXIT_FAILURE, "%s: two transmit sessions numbered "
+                     "%" PRIu32 "; -f needs one fabtput process", __func__,
+                     id);
+            }
+            named[id] = true;
+            file_terminal_init(&gs->file, true, id,
+                               global_state.total_sessions);
+            t = &gs->file.terminal;
+        }
+        if (global_state.filters.n != 0) {
+            chain_init(&gs->chain, t, true);
+            t = &gs->chain.terminal;
+        }
+        if (!session_init(&gs->sess, &r->cxn, t))
             errx(EXIT_FAILURE, "%s: failed to initialize session", __func__);
     }
 
+    free(named);
+
     for (i = 0; i < global_state.total_sessions; i++) {
         gs = &gst->session[i];
 
+        cxn_weight_set(&gs->rcvr.cxn, i);
+        monitor_register(&gs->rcvr.cxn);
+
+        if (global_state.run_to_completion)
+            continue;
+
         if ((w = workers_assign_session(gs->sess)) == NULL) {
             errx(EXIT_FAILURE,
                  "%s: could not assign a new receiver to a worker", __func__);
         }
     }
 
+    if (global_state.run_to_completion) {
+        session_t **sess;
+
+        if ((sess = calloc(global_state.total_sessions, sizeof(*sess))) ==
+            NULL)
+            err(EXIT_FAILURE, "%s: calloc", __func__);
+
+        for (i = 0; i < global_state.total_sessions; i++)
+            sess[i] = &gst->session[i].sess;
+
+        return sessions_run_to_completion(sess, global_state.total_sessions);
+    }
+
     return workers_join_all();
 }
 
@@ -4295,7 +8024,9 @@ put_session_setup(put_state_t *pst, put_session_t *ps)
 {
     struct fi_cq_attr cq_attr = {.size = 128,
                                  .flags = 0,
-                                 .format = FI_CQ_FORMAT_MSG,
+                                 .format = global_state.multi_recv
+                                               ? FI_CQ_FORMAT_DATA
+                                               : FI_CQ_FORMAT_MSG,
                                  .wait_obj = global_state.waitfd ? FI_WAIT_FD
                                                                  : FI_WAIT_NONE,
                                  .signaling_vector = 0,
@@ -4308,6 +8039,8 @@ put_session_setup(put_state_t *pst, put_session_t *ps)
                           NULL)) != 0)
         bailout_for_ofi_ret(rc, "fi_endpoint");
 
+    ep_multi_recv_setopt(x->cxn.ep, sizeof(vector_msg_t));
+
     if ((rc = fi_cq_open(global_state.domain, &cq_attr, &x->cxn.cq, &x->cxn)) !=
         0)
         bailout_for_ofi_ret(rc, "fi_cq_open");
@@ -4340,7 +8073,8 @@ put_session_setup(put_state_t *pst, put_session_t *ps)
     /* Setup initial message. */
     memset(&x->initial.msg, 0, sizeof(x->initial.msg));
     x->initial.msg.nsources = global_state.total_sessions;
-    x->initial.msg.id = 0;
+    x->initial.msg.id = (uint32_t) (ps - pst->session);
+    x->initial.msg.timed = (global_state.duration.length != 0) ? 1 : 0;
 
     x->initial.desc = fi_mr_desc(x->initial.mr);
 
@@ -4393,10 +8127,25 @@ put(void)
         ps = &pst->session[i];
         xmtr_t *x = &ps->xmtr;
         source_t *s = &ps->source;
-        xmtr_init(x, pst->av);
-        source_init(s);
+        terminal_t *t = &s->terminal;
 
-        if (!session_init(&ps->sess, &x->cxn, &s->terminal))
+        xmtr_init(x, pst->av);
+        source_init(s, i);
+
+        if (global_state.file_path != NULL &&
+            strcmp(global_state.file_path, "-") == 0) {
+            stream_terminal_init(&ps->stream, false);
+            t = &ps->stream.terminal;
+        } else if (global_state.file_path != NULL) {
+            file_terminal_init(&ps->file, false, i,
+                               global_state.total_sessions);
+            t = &ps->file.terminal;
+        }
+        if (global_state.filters.n != 0) {
+            chain_init(&ps->chain, t, false);
+            t = &ps->chain.terminal;
+        }
+        if (!session_init(&ps->sess, &x->cxn, t))
             errx(EXIT_FAILURE, "%s: failed to initialize session", __func__);
 
         xmtr_buffers_init(x);
@@ -4406,6 +8155,12 @@ put(void)
     for (i = 0; i < global_state.local_sessions; i++) {
         ps = &pst->session[i];
 
+        cxn_weight_set(&ps->xmtr.cxn, i);
+        monitor_register(&ps->xmtr.cxn);
+
+        if (global_state.run_to_completion)
+            continue;
+
         if ((w = workers_assign_session(ps->sess)) == NULL) {
             errx(EXIT_FAILURE,
                  "%s: could not assign a new transmitter to a worker",
@@ -4413,6 +8168,19 @@ put(void)
         }
     }
 
+    if (global_state.run_to_completion) {
+        session_t **sess;
+
+        if ((sess = calloc(global_state.local_sessions, sizeof(*sess))) ==
+            NULL)
+            err(EXIT_FAILURE, "%s: calloc", __func__);
+
+        for (i = 0; i < global_state.local_sessions; i++)
+            sess[i] = &pst->session[i].sess;
+
+        return sessions_run_to_completion(sess, global_state.local_sessions);
+    }
+
     return workers_join_all();
 }
 
@@ -4441,21 +8209,77 @@ personality_to_name(personality_t p)
         return "unknown";
 }
 
+/* Create the live statistics segment at `path` and map it so that
+ * workers and connections set up afterward publish their counters
+ * there.  The file remains after the program exits so that monitors
+ * can read the final counts.
+ */
+static void
+stats_segment_open(const char *path)
+{
+    fabtstats_segment_t *seg;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+        err(EXIT_FAILURE, "%s: open(\"%s\")", __func__, path);
+
+    if (ftruncate(fd, sizeof(*seg)) == -1)
+        err(EXIT_FAILURE, "%s: ftruncate(\"%s\")", __func__, path);
+
+    seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+        err(EXIT_FAILURE, "%s: mmap(\"%s\")", __func__, path);
+
+    (void) close(fd);
+
+    /* ftruncate(2) zeroed the counters. */
+    seg->version = FABTSTATS_VERSION;
+    seg->segment_size = sizeof(*seg);
+    seg->workers_max = arraycount(seg->worker);
+    seg->sessions_max = arraycount(seg->session);
+    seg->pid = (uint32_t) getpid();
+    (void) snprintf(seg->personality, sizeof(seg->personality), "%s",
+                    personality_to_name(global_state.personality));
+    atomic_store_explicit(&seg->magic, FABTSTATS_MAGIC, memory_order_release);
+
+    stats_segment = seg;
+}
+
+static void
+stats_segment_close(void)
+{
+    if (stats_segment == NULL)
+        return;
+
+    atomic_store_explicit(&stats_segment->exited, 1, memory_order_release);
+
+    if (munmap(stats_segment, sizeof(*stats_segment)) == -1)
+        warn("%s: munmap", __func__);
+
+    stats_segment = NULL;
+}
+
 /* Note that there is a doc/usage.md file that mirrors this, so please keep
  * that file in sync with this one.
  */
 static void
 usage(personality_t personality, const char *progname)
 {
-    const char *common1 = "[-c]";
-    const char *common2 = "[-n <n>] [-p '<i> - <j>' ] [-r] [-w]";
+    const char *common1 = "[-b] [-B <bytes>] [-c] [-D [<w>,]<d>]";
+    const char *common2 = "[-e] [-f <path>] [-F <filter>[,<filter>...]] "
+                          "[-i <s>] [-j] [-m <path>] [-M] [-n <n>] "
+                          "[-p '<i> - <j>' ] [-q <w>[,<w>...]] [-Q <n>] "
+                          "[-r] [-R] [-s <s>] [-S <s>] [-t] [-u] [-w] "
+                          "[-W '<min> - <max>']";
 
     fprintf(stderr, "\n");
     fprintf(stderr, "USAGE:\n");
     fprintf(stderr, "\n");
 
     if (personality == put) {
-        fprintf(stderr, "    %s %s [-g] [-h] [-k <k>] %s <remote_address>\n",
+        fprintf(stderr,
+                "    %s %s [-d <dist>] [-g] [-h] [-k <k>] [-l <n>] [-T] %s "
+                "<remote_address>\n",
                 progname, common1, common2);
     } else {
         fprintf(stderr, "    %s [-a <address-file>] [-h] %s %s\n", progname,
@@ -4470,6 +8294,20 @@ usage(personality_t personality, const char *progname)
         fprintf(stderr, "\n");
     }
 
+    fprintf(stderr, "    -b\n");
+    fprintf(stderr, "        post receives, transmissions and RDMA writes "
+                    "in batches, setting\n");
+    fprintf(stderr, "        FI_MORE on all but the last operation of "
+                    "each batch\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -B <bytes>\n");
+    fprintf(stderr, "        make every payload buffer <bytes> long "
+                    "(1 to 65536); with a multiple\n");
+    fprintf(stderr, "        of the page size, -f uses O_DIRECT and "
+                    "registered io_uring buffers\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "    -c\n");
     fprintf(stderr, "        Expect cancellation by a signal. Use exit code 0 "
                     "(success) if the\n");
@@ -4478,6 +8316,30 @@ usage(personality_t personality, const char *progname)
     fprintf(stderr, "        exit code 1 (failure), otherwise.\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "    -D [<w>,]<d>\n");
+    fprintf(stderr, "        run for w seconds (default 0) of warm-up, "
+                    "then measure for d\n");
+    fprintf(stderr, "        seconds and end the stream, instead of "
+                    "moving a fixed number of\n");
+    fprintf(stderr, "        bytes; the -i \"total\" record covers only "
+                    "the d seconds.  The\n");
+    fprintf(stderr, "        warm-up starts at the first byte moved.  "
+                    "Give both ends the same -D\n");
+    fprintf(stderr, "\n");
+
+    if (personality == put) {
+        fprintf(stderr, "    -d <dist>[@<seed>]\n");
+        fprintf(stderr, "        draw the number of bytes in each buffer "
+                        "from <dist>: fixed:<n>,\n");
+        fprintf(stderr, "        uniform:<min>-<max>, "
+                        "bimodal:<a>,<b>,<probability of a>,\n");
+        fprintf(stderr, "        lognormal:<median>,<sigma>,<max>, or "
+                        "hist:<path> (lines of\n");
+        fprintf(stderr, "        `<size> <count>`); the generator starts "
+                        "from <seed> (default 1)\n");
+        fprintf(stderr, "\n");
+    }
+
     if (personality == put) {
         fprintf(stderr, "    -g\n");
         fprintf(stderr, "        RDMA-write only from contiguous buffers "
@@ -4485,10 +8347,80 @@ usage(personality_t personality, const char *progname)
         fprintf(stderr, "\n");
     }
 
+    fprintf(stderr, "    -e\n");
+    fprintf(stderr, "        count cycles, instructions, LLC misses and branch "
+                    "misses in each\n");
+    fprintf(stderr, "        worker thread with perf_event_open(2); report "
+                    "them per byte and\n");
+    fprintf(stderr, "        per completion at exit\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -f <path>\n");
+    if (personality == put) {
+        fprintf(stderr, "        send the contents of file <path> "
+                        "instead of a generated payload,\n");
+        fprintf(stderr, "        reading with io_uring(7); session i of "
+                        "several reads <path>.i,\n");
+        fprintf(stderr, "        so -k must equal -n; with <path> \"-\", "
+                        "send standard input with\n");
+        fprintf(stderr, "        one session\n");
+    } else {
+        fprintf(stderr, "        write the payload to file <path> "
+                        "instead of verifying it, using\n");
+        fprintf(stderr, "        io_uring(7); session i of several "
+                        "writes <path>.i; with <path>\n");
+        fprintf(stderr, "        \"-\", write standard output with one "
+                        "session\n");
+    }
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -F <filter>[,<filter>...]\n");
+    fprintf(stderr, "        pass the payload of each session through "
+                    "these filters, in order,\n");
+    fprintf(stderr, "        %s; log the bytes and the time "
+                    "of each filter at exit.\n",
+            (personality == put) ? "after the source" : "before the sink");
+    fprintf(stderr, "        Filters: adler32 (log an Adler-32 checksum of "
+                    "the stream), count,\n        %s\n",
+            (personality == put)
+                ? "compress (LZ77 frames; fabtget decodes them with "
+                  "decompress)"
+                : "decompress (decode the frames of fabtput's compress)");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "    -h\n");
     fprintf(stderr, "        print this help message\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "    -i <s>\n");
+    fprintf(stderr, "        every s seconds, print per-session and aggregate "
+                    "bytes/s, RDMA\n");
+    fprintf(stderr, "        writes/s, control messages/s and FIFO occupancy "
+                    "to stdout as CSV;\n");
+    fprintf(stderr, "        print a \"total\" record at exit, timed from "
+                    "the first byte moved\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -j\n");
+    fprintf(stderr, "        print -i records as JSON lines instead of CSV\n");
+    fprintf(stderr, "\n");
+
+    if (personality == put) {
+        fprintf(stderr, "    -l <n>\n");
+        fprintf(stderr, "        request a completion only on every nth "
+                        "RDMA write and on a write\n");
+        fprintf(stderr, "        that no other write is sure to follow "
+                        "(default 1, every write)\n");
+        fprintf(stderr, "\n");
+    }
+
+    fprintf(stderr, "    -m <path>\n");
+    fprintf(stderr, "        export live per-worker and per-session counters "
+                    "in a shared\n");
+    fprintf(stderr, "        memory segment at path (e.g., under /dev/shm) "
+                    "for fabtstat(1)\n");
+    fprintf(stderr, "\n");
+
     if (personality == put) {
         fprintf(stderr, "    -k <k>\n");
         fprintf(stderr, "        Start only k transmit sessions. Use this "
@@ -4497,6 +8429,14 @@ usage(personality_t personality, const char *progname)
         fprintf(stderr, "\n");
     }
 
+    fprintf(stderr, "    -M\n");
+    fprintf(stderr, "        receive control messages in a few large "
+                    "FI_MULTI_RECV buffers\n");
+    fprintf(stderr, "        instead of one posted buffer per message; "
+                    "give -M to both\n");
+    fprintf(stderr, "        fabtget and fabtput\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "    -n\n");
     fprintf(stderr, "        Tell the peer to expect that between this process "
                     "and the other fabtput\n");
@@ -4511,17 +8451,89 @@ usage(personality_t personality, const char *progname)
     fprintf(stderr, "        pin worker threads to processors i through j\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "    -q <w>[,<w>...]\n");
+    fprintf(stderr, "        schedule sessions by deficit round-robin: on "
+                    "each pass, session i\n");
+    fprintf(stderr, "        gains w[i %% n] RDMA writes or vector messages "
+                    "of credit, where n is\n");
+    fprintf(stderr, "        the number of weights (1 to 1024 each, up to "
+                    "16 weights); a\n");
+    fprintf(stderr, "        session with work left carries up to one pass "
+                    "of unspent credit\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -Q <n>\n");
+    fprintf(stderr, "        with -f, keep up to <n> reads or writes in "
+                    "flight per session (1 to\n");
+    fprintf(stderr, "        64, default 32)\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "    -r\n");
     fprintf(stderr,
             "        deregister/(r)eregister each RDMA buffer before reuse\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "    -R\n");
+    fprintf(stderr, "        run every session to completion on the main "
+                    "thread, without\n");
+    fprintf(stderr, "        worker threads or poll sets; conflicts with -w "
+                    "and -W\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -s <s>\n");
+    fprintf(stderr, "        report each session that moves no bytes for s "
+                    "seconds, logging its\n");
+    fprintf(stderr, "        state (FIFO occupancy, EOF flags, posted "
+                    "operations) to stderr\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -S <s>\n");
+    fprintf(stderr, "        like -s, but also cancel each stalled session "
+                    "so that the program\n");
+    fprintf(stderr, "        fails promptly instead of hanging\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "    -t\n");
+    fprintf(stderr, "        time each stage of the session loop; log a "
+                    "table of calls and\n");
+    fprintf(stderr, "        time per stage for each session as it ends and "
+                    "for all sessions\n");
+    fprintf(stderr, "        at exit\n");
+    fprintf(stderr, "\n");
+
+    if (personality == put) {
+        fprintf(stderr, "    -T\n");
+        fprintf(stderr, "        RDMA-write with FI_TRANSMIT_COMPLETE instead "
+                        "of FI_DELIVERY_COMPLETE;\n");
+        fprintf(stderr, "        send progress messages with FI_FENCE unless "
+                        "the provider orders\n");
+        fprintf(stderr, "        sends after writes (FI_ORDER_SAW)\n");
+        fprintf(stderr, "\n");
+    }
+
+    fprintf(stderr, "    -u\n");
+    fprintf(stderr, "        report each worker's CPU seconds per GB moved, "
+                    "share of time on\n");
+    fprintf(stderr, "        CPU, and share of idle loops at exit, and the "
+                    "sum over workers\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "    -w\n");
     fprintf(stderr, "        wait for I/O using epoll_pwait(2) instead of "
                     "polling in a busy loop\n");
     fprintf(stderr, "        with fi_poll(3)\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "    -W '<min> - <max>'\n");
+    fprintf(stderr, "        size the worker pool by utilization: spread "
+                    "sessions over at least\n");
+    fprintf(stderr, "        min workers, start another worker when the "
+                    "others are busy, up to\n");
+    fprintf(stderr, "        max workers, and park a lightly loaded worker "
+                    "after handing off\n");
+    fprintf(stderr, "        its sessions\n");
+    fprintf(stderr, "\n");
+
     if (personality == put) {
         fprintf(stderr, "    <remote_address>\n");
         fprintf(stderr,
@@ -4622,8 +8634,28 @@ await_cancellation(void transfer_unused *arg)
     return NULL;
 }
 
+/* Parse a positive, possibly fractional, number of seconds and return
+ * it in nanoseconds.
+ */
+static uint64_t
+parse_seconds(const char *s, char flagname)
+{
+    char *end;
+    double secs;
+
+    errno = 0;
+    secs = strtod(s, &end);
+    if (end == s || *end != '\0') {
+        errx(EXIT_FAILURE, "could not parse `-%c` parameter `%s`", flagname, s);
+    }
+    if (errno != 0 || !(secs >= 1e-9 && secs < 1e9)) {
+        errx(EXIT_FAILURE, "`-%c` parameter `%s` is out of range", flagname, s);
+    }
+    return (uint64_t) (secs * 1e9);
+}
+
 static size_t
-parse_nsessions(const char *s, char flagname)
+parse_count(const char *s, char flagname)
 {
     char *end;
     uintmax_t n;
@@ -4639,6 +8671,206 @@ parse_nsessions(const char *s, char flagname)
     return (size_t) n;
 }
 
+/* Parse `[<warm-up>,]<length>` seconds for -D.  The warm-up may be 0. */
+static void
+parse_duration(const char *s)
+{
+    const char *comma = strchr(s, ',');
+    char *end;
+    double warmup = 0;
+
+    if (comma != NULL) {
+        errno = 0;
+        warmup = strtod(s, &end);
+        if (end != comma)
+            errx(EXIT_FAILURE, "could not parse `-D` parameter `%s`", s);
+        if (errno != 0 || !(warmup >= 0 && warmup < 1e9))
+            errx(EXIT_FAILURE, "`-D` parameter `%s` is out of range", s);
+    }
+
+    global_state.duration.warmup = (uint64_t) (warmup * 1e9);
+    global_state.duration.length =
+        parse_seconds((comma != NULL) ? comma + 1 : s, 'D');
+}
+
+/* Load the histogram of buffer sizes for `-d hist:<path>`.  Each line
+ * of the file holds a size and the number of times it occurs.
+ */
+static void
+parse_size_histogram(const char *path)
+{
+    FILE *f;
+    size_t size;
+    uint64_t count, cum = 0;
+    size_bin_t *bin = NULL;
+    size_t n = 0;
+    int rc;
+
+    if ((f = fopen(path, "r")) == NULL)
+        err(EXIT_FAILURE, "%s: fopen(\"%s\")", __func__, path);
+
+    while ((rc = fscanf(f, "%zu %" SCNu64, &size, &count)) == 2) {
+        if (size < 1 || source_size_max < size)
+            errx(EXIT_FAILURE, "%s: size %zu is out of range", path, size);
+        if (count == 0)
+            continue;
+        if ((bin = realloc(bin, (n + 1) * sizeof(*bin))) == NULL)
+            err(EXIT_FAILURE, "%s: realloc", __func__);
+        cum += count;
+        bin[n++] = (size_bin_t){.size = size, .cum = cum};
+        if (size > global_state.sizes.max)
+            global_state.sizes.max = size;
+    }
+
+    if (rc != EOF || ferror(f))
+        errx(EXIT_FAILURE, "%s: expected lines of `<size> <count>`", path);
+    if (n == 0)
+        errx(EXIT_FAILURE, "%s: no sizes", path);
+
+    (void) fclose(f);
+
+    global_state.sizes.bin = bin;
+    global_state.sizes.nbins = n;
+}
+
+/* Parse the buffer-size distribution for -d:
+ *
+ *     fixed:<n>
+ *     uniform:<min>-<max>
+ *     bimodal:<a>,<b>,<probability of a>
+ *     lognormal:<median>,<sigma>,<max>
+ *     hist:<path>
+ *
+ * followed by an optional `@<seed>`.
+ */
+static void
+parse_sizes(const char *s)
+{
+    char *arg, *at, *end;
+    int ninput = 0;
+
+    if ((arg = strdup(s)) == NULL)
+        err(EXIT_FAILURE, "%s: strdup", __func__);
+
+    global_state.sizes.seed = 1;
+    if ((at = strrchr(arg, '@')) != NULL) {
+        *at = '\0';
+        errno = 0;
+        global_state.sizes.seed = strtoull(at + 1, &end, 0);
+        if (end == at + 1 || *end != '\0' || errno != 0)
+            errx(EXIT_FAILURE, "could not parse `-d` seed in `%s`", s);
+    }
+
+    if (strncmp(arg, "hist:", 5) == 0) {
+        global_state.sizes.dist = sd_hist;
+        global_state.sizes.max = 0;
+        parse_size_histogram(arg + 5);
+        free(arg);
+        return;
+    }
+
+    if (sscanf(arg, "fixed:%zu%n", &global_state.sizes.a, &ninput) == 1 &&
+        arg[ninput] == '\0') {
+        global_state.sizes.dist = sd_fixed;
+        global_state.sizes.max = global_state.sizes.a;
+    } else if (sscanf(arg, "uniform:%zu-%zu%n", &global_state.sizes.a,
+                      &global_state.sizes.b, &ninput) == 2 &&
+               arg[ninput] == '\0') {
+        global_state.sizes.dist = sd_uniform;
+        global_state.sizes.max = global_state.sizes.b;
+    } else if (sscanf(arg, "bimodal:%zu,%zu,%lf%n", &global_state.sizes.a,
+                      &global_state.sizes.b, &global_state.sizes.p,
+                      &ninput) == 3 &&
+               arg[ninput] == '\0') {
+        global_state.sizes.dist = sd_bimodal;
+        global_state.sizes.max =
+            (global_state.sizes.a > global_state.sizes.b)
+                ? global_state.sizes.a
+                : global_state.sizes.b;
+    } else if (sscanf(arg, "lognormal:%zu,%lf,%zu%n", &global_state.sizes.a,
+                      &global_state.sizes.sigma, &global_state.sizes.max,
+                      &ninput) == 3 &&
+               arg[ninput] == '\0') {
+        global_state.sizes.dist = sd_lognormal;
+    } else {
+        errx(EXIT_FAILURE, "could not parse `-d` parameter `%s`", s);
+    }
+
+    free(arg);
+
+    if (global_state.sizes.a < 1 || global_state.sizes.max < 1 ||
+        source_size_max < global_state.sizes.max ||
+        (global_state.sizes.dist == sd_uniform &&
+         global_state.sizes.b < global_state.sizes.a) ||
+        (global_state.sizes.dist == sd_bimodal &&
+         (global_state.sizes.b < 1 || !(0 <= global_state.sizes.p &&
+                                        global_state.sizes.p <= 1))) ||
+        (global_state.sizes.dist == sd_lognormal &&
+         !(0 <= global_state.sizes.sigma)))
+        errx(EXIT_FAILURE, "`-d` parameter `%s` is out of range", s);
+}
+
+/* Parse a comma-separated list of filter names for -F. */
+static void
+parse_filters(const char *s)
+{
+    const char *p = s;
+    size_t i, len;
+
+    global_state.filters.n = 0;
+
+    for (;; p += len + 1) {
+        len = strcspn(p, ",");
+        for (i = 0; i < arraycount(filter_kinds); i++) {
+            if (strlen(filter_kinds[i].name) == len &&
+                strncmp(filter_kinds[i].name, p, len) == 0)
+                break;
+        }
+        if (i == arraycount(filter_kinds))
+            errx(EXIT_FAILURE, "unknown `-F` filter in `%s`", s);
+        if (global_state.personality == get ? !filter_kinds[i].get
+                                            : !filter_kinds[i].put) {
+            errx(EXIT_FAILURE, "`-F` filter `%.*s` runs only on %s",
+                 (int) len, p, filter_kinds[i].get ? "fabtget" : "fabtput");
+        }
+        if (global_state.filters.n == FILTERS_MAX) {
+            errx(EXIT_FAILURE, "`-F` parameter `%s` has more than %d filters",
+                 s, FILTERS_MAX);
+        }
+        global_state.filters.kind[global_state.filters.n++] = i;
+        if (p[len] == '\0')
+            break;
+    }
+}
+
+/* Parse a comma-separated list of session weights for -q. */
+static void
+parse_weights(const char *s)
+{
+    const char *p = s;
+    char *end;
+    uintmax_t w;
+
+    global_state.weights.n = 0;
+
+    do {
+        if (global_state.weights.n == arraycount(global_state.weights.w)) {
+            errx(EXIT_FAILURE, "`-q` parameter `%s` has more than %zu weights",
+                 s, arraycount(global_state.weights.w));
+        }
+        errno = 0;
+        w = strtoumax(p, &end, 10);
+        if (end == p || (*end != '\0' && *end != ',')) {
+            errx(EXIT_FAILURE, "could not parse `-q` parameter `%s`", s);
+        }
+        if (errno != 0 || w < 1 || 1024 < w) {
+            errx(EXIT_FAILURE, "`-q` parameter `%s` is out of range", s);
+        }
+        global_state.weights.w[global_state.weights.n++] = (unsigned) w;
+        p = end + 1;
+    } while (*end == ',');
+}
+
 int
 main(int argc, char **argv)
 {
@@ -4666,7 +8898,9 @@ main(int argc, char **argv)
     }
 
     const char *optstring =
-        (global_state.personality == get) ? "a:chn:p:rw" : "cghk:n:p:rw";
+        (global_state.personality == get)
+            ? "a:bB:cD:ef:F:hi:jm:Mn:p:q:Q:rRs:S:tuwW:"
+            : "bB:cd:D:ef:F:ghi:jk:l:m:Mn:p:q:Q:rRs:S:tTuwW:";
 
     while ((opt = getopt(argc, argv, optstring)) != -1) {
         switch (opt) {
@@ -4676,22 +8910,61 @@ main(int argc, char **argv)
                         __func__);
                 }
                 break;
+            case 'b':
+                global_state.batch = true;
+                break;
+            case 'B':
+                global_state.bufsize = parse_count(optarg, 'B');
+                if (source_size_max < global_state.bufsize)
+                    errx(EXIT_FAILURE, "`-B` parameter `%s` is out of range",
+                         optarg);
+                break;
             case 'c':
                 global_state.expect_cancellation = true;
                 break;
+            case 'd':
+                parse_sizes(optarg);
+                break;
+            case 'D':
+                parse_duration(optarg);
+                break;
             case 'g':
                 global_state.contiguous = true;
                 break;
+            case 'e':
+                global_state.perf = true;
+                break;
+            case 'f':
+                global_state.file_path = optarg;
+                break;
+            case 'F':
+                parse_filters(optarg);
+                break;
             case 'h':
                 usage(global_state.personality, progname);
                 exit(EXIT_SUCCESS);
+            case 'i':
+                global_state.report.interval = parse_seconds(optarg, 'i');
+                break;
+            case 'j':
+                global_state.report.json = true;
+                break;
+            case 'l':
+                global_state.signal_interval = parse_count(optarg, 'l');
+                break;
+            case 'm':
+                global_state.stats_path = optarg;
+                break;
+            case 'M':
+                global_state.multi_recv = true;
+                break;
             case 'k':
                 set.k = true;
-                global_state.local_sessions = parse_nsessions(optarg, 'k');
+                global_state.local_sessions = parse_count(optarg, 'k');
                 break;
             case 'n':
                 set.n = true;
-                global_state.total_sessions = parse_nsessions(optarg, 'n');
+                global_state.total_sessions = parse_count(optarg, 'n');
                 break;
             case 'p':
                 ninput = 0;
@@ -4706,22 +8979,76 @@ main(int argc, char **argv)
                     errx(EXIT_FAILURE, "unexpected `-p` parameter `%s`",
                          optarg);
                 break;
+            case 'q':
+                parse_weights(optarg);
+                break;
+            case 'Q':
+                /* A file terminal cannot have more I/O in flight than a
+                 * session FIFO holds buffers.
+                 */
+                if (64 < (i = parse_count(optarg, 'Q')))
+                    errx(EXIT_FAILURE, "`-Q` parameter `%s` is out of range",
+                         optarg);
+                global_state.file_depth = (unsigned) i;
+                break;
             case 'r':
                 global_state.reregister = true;
                 break;
+            case 'R':
+                global_state.run_to_completion = true;
+                break;
+            case 's':
+            case 'S':
+                global_state.stall.interval = parse_seconds(optarg, opt);
+                global_state.stall.cancel = (opt == 'S');
+                break;
+            case 't':
+                global_state.stages = true;
+                break;
+            case 'T':
+                global_state.transmit_complete = true;
+                break;
+            case 'u':
+                global_state.cpu_report = true;
+                break;
             case 'w':
                 global_state.waitfd = true;
                 break;
+            case 'W':
+                ninput = 0;
+                (void) sscanf(optarg, "%zu - %zu%n", &global_state.pool.min,
+                              &global_state.pool.max, &ninput);
+                if (ninput == 0 || optarg[ninput] != '\0')
+                    errx(EXIT_FAILURE, "unexpected `-W` parameter `%s`",
+                         optarg);
+                if (global_state.pool.max < 1 ||
+                    WORKERS_MAX < global_state.pool.max ||
+                    global_state.pool.max < global_state.pool.min)
+                    errx(EXIT_FAILURE, "`-W` parameter `%s` is out of range",
+                         optarg);
+                global_state.pool.adaptive = true;
+                break;
             default:
                 usage(global_state.personality, progname);
                 exit(EXIT_FAILURE);
         }
     }
 
+    if (global_state.run_to_completion &&
+        (global_state.waitfd || global_state.pool.adaptive))
+        errx(EXIT_FAILURE, "`-R` conflicts with `-w` and `-W`");
+
+    if (global_state.sizes.dist != sd_buffer && global_state.file_path != NULL)
+        errx(EXIT_FAILURE, "`-d` conflicts with `-f`");
+
+    if (global_state.duration.length != 0 && global_state.file_path != NULL)
+        errx(EXIT_FAILURE, "`-D` conflicts with `-f`");
+
     argc -= optind;
     argv += optind;
 
     global_state.nextcpu = (int) global_state.processors.first;
+    global_state.page_size = (size_t) sysconf(_SC_PAGESIZE);
 
     if (global_state.personality == put) {
         if (argc != 1) {
@@ -4749,6 +9076,39 @@ main(int argc, char **argv)
         }
     }
 
+    /* fabtput numbers its files by session from 0, as fabtget does,
+     * which only matches when one fabtput process starts every session.
+     */
+    if (global_state.file_path != NULL &&
+        strcmp(global_state.file_path, "-") != 0 &&
+        global_state.local_sessions != global_state.total_sessions)
+        errx(EXIT_FAILURE, "-f needs -k equal to -n");
+
+    if (global_state.file_path != NULL &&
+        strcmp(global_state.file_path, "-") == 0) {
+        if (((global_state.personality == get)
+                 ? global_state.total_sessions
+                 : global_state.local_sessions) != 1)
+            errx(EXIT_FAILURE, "`-f -` needs exactly one session");
+
+        /* The payload has standard output to itself, so send the
+         * address and the reports to standard error.
+         */
+        if (global_state.personality == put) {
+            global_state.stream_fd = STDIN_FILENO;
+        } else if ((global_state.stream_fd = dup(STDOUT_FILENO)) == -1 ||
+                   dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+            err(EXIT_FAILURE, "%s: could not redirect standard output",
+                __func__);
+        }
+    }
+
+    if (global_state.stats_path != NULL)
+        stats_segment_open(global_state.stats_path);
+
+    stage_epoch.ticks = stage_clock();
+    stage_epoch.ns = clock_ns(CLOCK_MONOTONIC);
+
     workers_initialize();
 
     seqsource_init(&global_state.keys);
@@ -4764,6 +9124,22 @@ main(int argc, char **argv)
     hints->caps |= FI_RMA;
     hints->caps |= FI_REMOTE_READ | FI_READ | FI_REMOTE_WRITE | FI_WRITE;
     hints->mode = FI_CONTEXT;
+    if (global_state.transmit_complete)
+        hints->caps |= FI_FENCE;
+    if (global_state.multi_recv) {
+        /* The ack and the control messages that follow it are all
+         * untagged, so the ack must arrive first to land in the receive
+         * posted for it.
+         */
+        hints->caps |= FI_MULTI_RECV;
+        hints->tx_attr->msg_order |= FI_ORDER_SAS;
+        hints->rx_attr->msg_order |= FI_ORDER_SAS;
+    }
+    /* With -l <n>, the completion of a signaled write stands for the
+     * unsignaled writes before it, so completions must be in order.
+     */
+    if (global_state.signal_interval > 1)
+        hints->tx_attr->comp_order = FI_ORDER_STRICT;
     /* FI_MR_ENDPOINT is *required* by cxi; `FI_MR_UNSPEC` will not do. */
     hints->domain_attr->mr_mode = FI_MR_ENDPOINT | FI_MR_PROV_KEY;
 
@@ -4859,6 +9235,8 @@ main(int argc, char **argv)
         goto out;
     }
 
+    monitor_start();
+
     rc = fi_fabric(global_state.info->fabric_attr, &global_state.fabric,
                    NULL /* app context */);
 
@@ -4909,6 +9287,22 @@ main(int argc, char **argv)
     hlog_fast(params, "maximum endpoint message size (RMA limit) 0x%zx",
               global_state.info->ep_attr->max_msg_size);
 
+    if (global_state.signal_interval > 1 &&
+        (global_state.info->tx_attr->comp_order & FI_ORDER_STRICT) == 0) {
+        errx(EXIT_FAILURE, "`-l` needs a provider that completes transmit "
+                           "operations in order (FI_ORDER_STRICT)");
+    }
+
+    global_state.progress_fence =
+        global_state.transmit_complete &&
+        (global_state.info->tx_attr->msg_order & FI_ORDER_SAW) == 0;
+
+    if (global_state.transmit_complete) {
+        hlog_fast(params, "RDMA writes transmit-complete, progress %s",
+                  global_state.progress_fence ? "fenced"
+                                              : "ordered by FI_ORDER_SAW");
+    }
+
     hlog_fast(params, "starting personality '%s'",
               personality_to_name(global_state.personality));
 
@@ -4922,6 +9316,9 @@ main(int argc, char **argv)
 
     ecode = (*global_state.personality)();
 
+    monitor_stop();
+    stats_segment_close();
+
     if ((rc = pthread_kill(global_state.cancel_thd, SIGUSR1)) != 0) {
         warnx("%s.%d: pthread_kill: %s", __func__, __LINE__, strerror(rc));
     }
@@ -0,0 +1,343 @@
+/**
+ * Copyright (c) 2021-2022, UChicago Argonne, LLC and The HDF Group.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/* fabtstat: periodically display the live statistics that
+ * `fabtget -m <path>` or `fabtput -m <path>` exports.
+ */
+
+#include <err.h>
+#include <fcntl.h>    /* open(2) */
+#include <inttypes.h> /* PRIu64 */
+#include <libgen.h>   /* basename(3) */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* strdup(3) */
+#include <time.h>   /* clock_gettime(2), nanosleep(2) */
+#include <unistd.h> /* getopt(3), isatty(3) */
+
+#include <sys/mman.h> /* mmap(2) */
+#include <sys/stat.h> /* fstat(2) */
+
+#include "fabtstats.h"
+
+#define arraycount(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+    uint64_t epoll_waitable, epoll_total;
+    uint64_t half_no_io, half_total;
+    uint64_t load_average;
+} worker_sample_t;
+
+typedef struct {
+    uint64_t state;
+    uint64_t nbytes, nwrites, nctlmsgs;
+    uint64_t cxn_fifo, terminal_fifo;
+} session_sample_t;
+
+typedef struct {
+    uint64_t time; // CLOCK_MONOTONIC nanoseconds
+    size_t nworkers, nsessions;
+    worker_sample_t worker[FABTSTATS_WORKERS_MAX];
+    session_sample_t session[FABTSTATS_SESSIONS_MAX];
+} sample_t;
+
+static sample_t samples[2];
+
+static uint64_t
+load(volatile _Atomic uint64_t *ctr)
+{
+    return atomic_load_explicit(ctr, memory_order_relaxed);
+}
+
+static uint64_t
+clock_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        err(EXIT_FAILURE, "%s: clock_gettime", __func__);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static size_t
+minsize(size_t l, size_t r)
+{
+    return (l < r) ? l : r;
+}
+
+static fabtstats_segment_t *
+segment_map(const char *path)
+{
+    fabtstats_segment_t *seg;
+    struct stat st;
+    size_t i;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        err(EXIT_FAILURE, "%s: open(\"%s\")", __func__, path);
+
+    if (fstat(fd, &st) == -1)
+        err(EXIT_FAILURE, "%s: fstat(\"%s\")", __func__, path);
+
+    if ((size_t) st.st_size < sizeof(*seg)) {
+        errx(EXIT_FAILURE, "%s: \"%s\" is too short for a stats segment",
+             __func__, path);
+    }
+
+    seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+        err(EXIT_FAILURE, "%s: mmap(\"%s\")", __func__, path);
+
+    (void) close(fd);
+
+    if (atomic_load_explicit(&seg->magic, memory_order_acquire) !=
+        FABTSTATS_MAGIC)
+        errx(EXIT_FAILURE, "%s: \"%s\" is not a stats segment", __func__, path);
+
+    /* Name the first field that differs, so that a segment from a
+     * build with other limits is not mistaken for a new version.
+     */
+    const struct {
+        const char *name;
+        uint32_t found;
+        size_t expected;
+    } layout[] = {
+        {"version", seg->version, FABTSTATS_VERSION},
+        {"segment_size", seg->segment_size, sizeof(*seg)},
+        {"workers_max", seg->workers_max, arraycount(seg->worker)},
+        {"sessions_max", seg->sessions_max, arraycount(seg->session)}};
+
+    for (i = 0; i < arraycount(layout); i++) {
+        if (layout[i].found != layout[i].expected) {
+            errx(EXIT_FAILURE,
+                 "%s: \"%s\" has stats layout %s %" PRIu32 ", expected %zu",
+                 __func__, path, layout[i].name, layout[i].found,
+                 layout[i].expected);
+        }
+    }
+
+    return seg;
+}
+
+static void
+segment_sample(fabtstats_segment_t *seg, sample_t *s)
+{
+    size_t i;
+
+    s->time = clock_ns();
+    s->nworkers = minsize(load(&seg->nworkers), arraycount(seg->worker));
+    s->nsessions = minsize(load(&seg->nsessions), arraycount(seg->session));
+
+    for (i = 0; i < s->nworkers; i++) {
+        fabtstats_worker_t *w = &seg->worker[i];
+
+        s->worker[i] =
+            (worker_sample_t){.epoll_waitable = load(&w->epoll_loops.waitable),
+                              .epoll_total = load(&w->epoll_loops.total),
+                              .half_no_io = load(&w->half_loops.no_io_ready),
+                              .half_total = load(&w->half_loops.total),
+                              .load_average = load(&w->load_average)};
+    }
+
+    for (i = 0; i < s->nsessions; i++) {
+        fabtstats_session_t *ss = &seg->session[i];
+
+        s->session[i] =
+            (session_sample_t){.state = load(&ss->state),
+                               .nbytes = load(&ss->nbytes),
+                               .nwrites = load(&ss->nwrites),
+                               .nctlmsgs = load(&ss->nctlmsgs),
+                               .cxn_fifo = load(&ss->cxn_fifo),
+                               .terminal_fifo = load(&ss->terminal_fifo)};
+    }
+}
+
+static double
+percent(uint64_t part, uint64_t whole)
+{
+    return (whole == 0) ? 0. : 100. * (double) part / (double) whole;
+}
+
+static const char *
+state_to_string(uint64_t state)
+{
+    switch (state) {
+        case FABTSTATS_SESSION_OPEN:
+            return "open";
+        case FABTSTATS_SESSION_CLOSED:
+            return "closed";
+        default:
+            return "free";
+    }
+}
+
+static void
+display(fabtstats_segment_t *seg, const sample_t *prev, const sample_t *cur,
+        bool clear)
+{
+    const double secs = (cur->time == prev->time)
+                            ? 1e-9
+                            : (double) (cur->time - prev->time) / 1e9;
+    double total_rate = 0.;
+    size_t i, nopen = 0;
+
+    for (i = 0; i < cur->nsessions; i++) {
+        if (cur->session[i].state == FABTSTATS_SESSION_OPEN)
+            nopen++;
+    }
+
+    if (clear)
+        printf("\033[H\033[2J");
+    else
+        printf("\n");
+
+    printf("%s pid %" PRIu32 ": %zu workers, %zu sessions, %zu open%s\n\n",
+           seg->personality, seg->pid, cur->nworkers, cur->nsessions, nopen,
+           load(&seg->exited) ? ", exited" : "");
+
+    printf("%7s %12s %9s %9s %8s\n", "WORKER", "LOOPS/S", "WAITABLE%",
+           "NO-I/O%", "LOAD");
+    for (i = 0; i < cur->nworkers; i++) {
+        const worker_sample_t *c = &cur->worker[i];
+        const worker_sample_t *p = (i < prev->nworkers)
+                                       ? &prev->worker[i]
+                                       : &(worker_sample_t){0, 0, 0, 0, 0};
+
+        printf("%7zu %12.0f %9.1f %9.1f %4" PRIu64 ".%03" PRIu64 "\n", i,
+               (double) (c->epoll_total - p->epoll_total) / secs,
+               percent(c->epoll_waitable - p->epoll_waitable,
+                       c->epoll_total - p->epoll_total),
+               percent(c->half_no_io - p->half_no_io,
+                       c->half_total - p->half_total),
+               c->load_average / 256, (c->load_average % 256) * 1000 / 256);
+    }
+
+    printf("\n%7s %6s %10s %10s %10s %8s %9s %14s\n", "SESSION", "STATE",
+           "MB/S", "WRITES/S", "CTLMSGS/S", "CXN-FIFO", "TERM-FIFO", "BYTES");
+    for (i = 0; i < cur->nsessions; i++) {
+        const session_sample_t *c = &cur->session[i];
+        const session_sample_t *p =
+            (i < prev->nsessions)
+                ? &prev->session[i]
+                : &(session_sample_t){0, 0, 0, 0, 0, 0};
+        const double rate = (double) (c->nbytes - p->nbytes) / secs;
+
+        total_rate += rate;
+
+        printf("%7zu %6s %10.1f %10.0f %10.0f %8" PRIu64 " %9" PRIu64
+               " %14" PRIu64 "\n",
+               i, state_to_string(c->state), rate / 1e6,
+               (double) (c->nwrites - p->nwrites) / secs,
+               (double) (c->nctlmsgs - p->nctlmsgs) / secs, c->cxn_fifo,
+               c->terminal_fifo, c->nbytes);
+    }
+
+    printf("\n%7s %6s %10.1f\n", "all", "", total_rate / 1e6);
+
+    (void) fflush(stdout);
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr, "\n");
+    fprintf(stderr, "USAGE:\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    %s [-h] [-i <s>] [-n <n>] <path>\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -h\n");
+    fprintf(stderr, "        print this help message\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -i <s>\n");
+    fprintf(stderr, "        update every s seconds (default 1)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -n <n>\n");
+    fprintf(stderr, "        quit after n updates\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    <path>\n");
+    fprintf(stderr, "        the stats segment that fabtget -m <path> or "
+                    "fabtput -m <path>\n");
+    fprintf(stderr, "        exports\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    fabtstats_segment_t *seg;
+    double interval = 1.;
+    unsigned long count = 0, n;
+    char *end, *progname;
+    bool clear;
+    int opt;
+
+    if ((progname = strdup(argv[0])) == NULL)
+        err(EXIT_FAILURE, "%s: strdup", __func__);
+
+    progname = basename(progname);
+
+    while ((opt = getopt(argc, argv, "hi:n:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage(progname);
+                exit(EXIT_SUCCESS);
+            case 'i':
+                interval = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(interval > 0.))
+                    errx(EXIT_FAILURE, "unexpected `-i` parameter `%s`",
+                         optarg);
+                break;
+            case 'n':
+                count = strtoul(optarg, &end, 0);
+                if (end == optarg || *end != '\0' || count == 0)
+                    errx(EXIT_FAILURE, "unexpected `-n` parameter `%s`",
+                         optarg);
+                break;
+            default:
+                usage(progname);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1) {
+        usage(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    seg = segment_map(argv[0]);
+    clear = isatty(STDOUT_FILENO);
+
+    const struct timespec pause = {
+        .tv_sec = (time_t) interval,
+        .tv_nsec = (long) ((interval - (double) (time_t) interval) * 1e9)};
+
+    segment_sample(seg, &samples[0]);
+
+    for (n = 0; count == 0 || n < count; n++) {
+        const sample_t *prev = &samples[n % 2];
+        sample_t *cur = &samples[(n + 1) % 2];
+        bool exited;
+
+        exited = atomic_load_explicit(&seg->exited, memory_order_acquire) != 0;
+
+        if (!exited)
+            (void) nanosleep(&pause, NULL);
+
+        segment_sample(seg, cur);
+        display(seg, prev, cur, clear);
+
+        if (exited)
+            break;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2021-2022, UChicago Argonne, LLC and The HDF Group.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/* Layout of the live statistics segment that `fabtget -m <path>` and
+ * `fabtput -m <path>` export, and that `fabtstat <path>` reads.
+ *
+ * The exporting process creates the file, sizes it to
+ * `sizeof(fabtstats_segment_t)`, fills in the header, and finally
+ * stores `FABTSTATS_MAGIC` to `magic` with release semantics.  Readers
+ * must check `magic`, `version`, and the size fields before they
+ * trust the rest of the segment.
+ *
+ * Each counter has exactly one writer, which updates it with relaxed
+ * atomic operations; readers load counters with relaxed atomic loads.
+ * Readers may observe counters from different instants, so rates
+ * computed from them are approximate.
+ */
+
+#ifndef _FABTSTATS_H
+#define _FABTSTATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define FABTSTATS_MAGIC   0x66616274737461ULL /* "fabtsta" */
+#define FABTSTATS_VERSION 1
+
+#define FABTSTATS_WORKERS_MAX  128
+#define FABTSTATS_SESSIONS_MAX 1024
+
+/* Values of `fabtstats_session_t.state`. */
+enum {
+    FABTSTATS_SESSION_FREE = 0, // slot not used yet
+    FABTSTATS_SESSION_OPEN,     // session is transferring
+    FABTSTATS_SESSION_CLOSED    // session has shut down
+};
+
+/* Per-session counters, written by the worker servicing the session. */
+typedef struct fabtstats_session {
+    volatile _Atomic uint64_t state;
+    volatile _Atomic uint64_t nbytes; /* payload bytes moved: written and
+                                       * retired (transmitter) or reported
+                                       * filled by the peer (receiver)
+                                       */
+    volatile _Atomic uint64_t nwrites;  // RDMA writes posted
+    volatile _Atomic uint64_t nctlmsgs; // control messages sent or received
+    /* Occupancy of the session FIFOs after the last pass. */
+    volatile _Atomic uint64_t cxn_fifo;      // ready_for_cxn
+    volatile _Atomic uint64_t terminal_fifo; // ready_for_terminal
+} fabtstats_session_t;
+
+/* Per-worker counters, written by the worker. */
+typedef struct fabtstats_worker {
+    struct {
+        volatile _Atomic uint64_t waitable;
+        volatile _Atomic uint64_t total;
+    } epoll_loops;
+    struct {
+        volatile _Atomic uint64_t no_io_ready;
+        volatile _Atomic uint64_t no_session_ready;
+        volatile _Atomic uint64_t total;
+    } half_loops;
+    /* Average completion queues serviced per loop, a fixed-point number
+     * with 8 bits right of the decimal point.
+     */
+    volatile _Atomic uint64_t load_average;
+} fabtstats_worker_t;
+
+typedef struct fabtstats_segment {
+    volatile _Atomic uint64_t magic; // FABTSTATS_MAGIC once initialized
+    uint32_t version;                // FABTSTATS_VERSION
+    uint32_t segment_size;           // sizeof(fabtstats_segment_t)
+    uint32_t workers_max;            // arraycount(worker)
+    uint32_t sessions_max;           // arraycount(session)
+    uint32_t pid;                    // exporting process
+    char personality[12];            // "fabtget" or "fabtput"
+    volatile _Atomic uint64_t nworkers;  // worker[] slots in use
+    volatile _Atomic uint64_t nsessions; // session[] slots in use
+    volatile _Atomic uint64_t exited;    // set when the exporter exits
+    fabtstats_worker_t worker[FABTSTATS_WORKERS_MAX];
+    fabtstats_session_t session[FABTSTATS_SESSIONS_MAX];
+} fabtstats_segment_t;
+
+#endif /* _FABTSTATS_H */